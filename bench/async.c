@@ -0,0 +1,191 @@
+#include "rigidbodylib.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Swinging chains stepped with rb_async_step while the main thread
+// "draws" the published positions, against stepping and drawing in turn.
+// A second reader thread grabs positions as fast as it can; afterwards
+// every frame it saw is checked against a plain rerun, so a torn or
+// mixed frame shows up as a mismatch.
+
+#define CHAIN_BONES 5
+#define BONE_LENGTH 20
+#define CHAINS 20000
+#define BONES (CHAINS * CHAIN_BONES)
+#define FRAMES 120
+#define DT (1.0f / 60.0f)
+#define MAX_SEEN 100000
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void build_scene(RB_Bone *bones)
+{
+  srand(4321);
+  for (size_t c = 0; c < CHAINS; ++c) {
+    RB_Bone *chain = &bones[c * CHAIN_BONES];
+    float x = (float)(c % 100) * 100;
+    float y = (float)(c / 100) * 100;
+
+    for (size_t i = 0; i < CHAIN_BONES; ++i) {
+      memset(&chain[i], 0, sizeof(RB_Bone));
+      chain[i].joint1_mass = 1;
+      chain[i].joint2_mass = 1;
+      chain[i].joint2_pos.x = x + (i + 1) * BONE_LENGTH;
+      chain[i].joint2_pos.y = y;
+    }
+    chain[0].joint1_mass = 0;
+    chain[0].joint1_pos.x = x;
+    chain[0].joint1_pos.y = y;
+    chain[0].length =
+        rb_calculate_distance(&chain[0].joint1_pos, &chain[0].joint2_pos);
+    for (size_t i = 1; i < CHAIN_BONES; ++i) {
+      rb_connect_bone(&chain[i - 1], &chain[i]);
+    }
+    chain[CHAIN_BONES - 1].joint2_velocity.y = (float)(rand() % 200 - 100);
+  }
+}
+
+static uint64_t positions_hash(const RB_Vector2 *positions)
+{
+  uint64_t hash = 1469598103934665603ull;
+  const unsigned char *bytes = (const unsigned char *)positions;
+  for (size_t i = 0; i < BONES * 2 * sizeof(RB_Vector2); ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// Stands in for the renderer: one pass over the positions.
+static float draw(const RB_Vector2 *positions)
+{
+  float sum = 0;
+  for (size_t i = 0; i < BONES * 2; ++i) {
+    sum += positions[i].x + positions[i].y;
+  }
+  return sum;
+}
+
+typedef struct {
+  RB_AsyncStep *async;
+  _Atomic int stop;
+  size_t seen;
+  uint64_t frames[MAX_SEEN];
+  uint64_t hashes[MAX_SEEN];
+} Reader;
+
+static void *reader_main(void *arg)
+{
+  Reader *reader = arg;
+  uint64_t last = UINT64_MAX;
+  while (!atomic_load(&reader->stop) && reader->seen < MAX_SEEN) {
+    uint64_t frame;
+    const RB_Vector2 *positions = rb_async_positions(reader->async, &frame);
+    if (frame != last) {
+      reader->frames[reader->seen] = frame;
+      reader->hashes[reader->seen++] = positions_hash(positions);
+      last = frame;
+    }
+  }
+  return 0;
+}
+
+int main(void)
+{
+  rb_init_config(0);
+
+  RB_Bone *bones = malloc(BONES * sizeof(RB_Bone));
+  uint64_t *expected = malloc((FRAMES + 1) * sizeof(uint64_t));
+  RB_Vector2 *positions = malloc(BONES * 2 * sizeof(RB_Vector2));
+  static Reader reader;
+  if (!bones || !expected || !positions) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  // In turn: step, then draw.
+  RB_World world;
+  build_scene(bones);
+  rb_world_init(&world, bones, BONES);
+  double t0 = now_seconds();
+  volatile float sink = 0;
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    rb_world_step(&world, DT);
+    for (size_t i = 0; i < BONES; ++i) {
+      positions[i * 2] = bones[i].joint1_pos;
+      positions[i * 2 + 1] = bones[i].joint2_pos;
+    }
+    sink += draw(positions);
+  }
+  double in_turn = now_seconds() - t0;
+
+  // Expected positions of every frame.
+  build_scene(bones);
+  rb_world_init(&world, bones, BONES);
+  for (int frame = 0; frame <= FRAMES; ++frame) {
+    for (size_t i = 0; i < BONES; ++i) {
+      positions[i * 2] = bones[i].joint1_pos;
+      positions[i * 2 + 1] = bones[i].joint2_pos;
+    }
+    expected[frame] = positions_hash(positions);
+    rb_world_step(&world, DT);
+  }
+
+  // Overlapped: draw the last published frame while the next one steps.
+  RB_Scheduler *scheduler = rb_scheduler_create(0);
+  RB_JobSystem jobs = rb_scheduler_job_system(scheduler);
+  rb_set_job_system(&jobs);
+
+  build_scene(bones);
+  rb_world_init(&world, bones, BONES);
+  RB_AsyncStep *async = rb_async_step_create(&world);
+  t0 = now_seconds();
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    rb_async_step(async, DT);
+    sink += draw(rb_async_positions(async, 0));
+  }
+  rb_async_step_wait(async);
+  double overlapped = now_seconds() - t0;
+  rb_async_step_destroy(async);
+
+  // Again with a reader thread polling the positions.
+  build_scene(bones);
+  rb_world_init(&world, bones, BONES);
+  async = rb_async_step_create(&world);
+  reader.async = async;
+  pthread_t thread;
+  pthread_create(&thread, 0, reader_main, &reader);
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    rb_async_step(async, DT);
+  }
+  rb_async_step_wait(async);
+  atomic_store(&reader.stop, 1);
+  pthread_join(thread, 0);
+
+  size_t bad = 0;
+  for (size_t i = 0; i < reader.seen; ++i) {
+    bad += reader.frames[i] > FRAMES ||
+           reader.hashes[i] != expected[reader.frames[i]];
+  }
+
+  printf("%d bones | in turn %6.2f ms/frame | async %6.2f ms/frame | "
+         "reader saw %zu frames, %zu inconsistent\n",
+         BONES, in_turn * 1e3 / FRAMES, overlapped * 1e3 / FRAMES,
+         reader.seen, bad);
+
+  rb_async_step_destroy(async);
+  rb_set_job_system(0);
+  rb_scheduler_destroy(scheduler);
+  free(positions);
+  free(expected);
+  free(bones);
+  return bad ? 1 : 0;
+}
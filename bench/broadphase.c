@@ -0,0 +1,228 @@
+#include "rigidbodylib.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Ragdoll-ish chains dropped onto a ground plane, the same shape of scene
+// as the friction example but scaled up. Compares sweep-and-prune against
+// a uniform grid rebuilt every step.
+
+#define GROUND_Y 400
+#define CHAIN_BONES 5
+#define BONE_LENGTH 12
+#define FRAMES 300
+#define DT (1.0f / 60.0f)
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void build_scene(RB_Bone *bones, size_t chains, float width)
+{
+  srand(1234);
+  for (size_t c = 0; c < chains; ++c) {
+    float x = (float)rand() / RAND_MAX * width;
+    float y = (float)rand() / RAND_MAX * -2000.0f;
+    RB_Bone *chain = &bones[c * CHAIN_BONES];
+
+    for (size_t i = 0; i < CHAIN_BONES; ++i) {
+      memset(&chain[i], 0, sizeof(RB_Bone));
+      chain[i].joint1_mass = 1;
+      chain[i].joint2_mass = 1;
+      chain[i].joint2_pos.x = x + (i + 1) * BONE_LENGTH;
+      chain[i].joint2_pos.y = y;
+    }
+    chain[0].joint1_pos.x = x;
+    chain[0].joint1_pos.y = y;
+    chain[0].length =
+        rb_calculate_distance(&chain[0].joint1_pos, &chain[0].joint2_pos);
+    for (size_t i = 1; i < CHAIN_BONES; ++i) {
+      rb_connect_bone(&chain[i - 1], &chain[i]);
+    }
+  }
+}
+
+static void step_scene(RB_Bone *bones, size_t bones_count)
+{
+  rb_update_bones(bones, bones_count, DT);
+  for (size_t i = 0; i < bones_count; ++i) {
+    if (bones[i].joint1_pos.y > GROUND_Y) {
+      bones[i].joint1_pos.y = GROUND_Y;
+    }
+    if (bones[i].joint2_pos.y > GROUND_Y) {
+      bones[i].joint2_pos.y = GROUND_Y;
+    }
+  }
+}
+
+typedef struct {
+  float cell_size;
+  int min_x, min_y, cols, rows;
+  uint32_t *cell_start; // cols * rows + 1 prefix offsets
+  uint32_t *cell_items;
+  size_t items_capacity;
+  RB_AABB *aabbs;
+} Grid;
+
+static int grid_cell(float v, float cell_size)
+{
+  return (int)floorf(v / cell_size);
+}
+
+// Counting-sort grid. A pair is reported only from the cell that holds the
+// lower-left corner of the two AABBs' intersection, so no dedup pass is needed.
+static size_t grid_update(Grid *grid, const RB_Bone *bones, size_t bones_count,
+                          RB_PairBuffer *pairs)
+{
+  pairs->count = 0;
+  grid->aabbs = realloc(grid->aabbs, bones_count * sizeof(RB_AABB));
+
+  RB_AABB bounds = {{INFINITY, INFINITY}, {-INFINITY, -INFINITY}};
+  for (size_t i = 0; i < bones_count; ++i) {
+    RB_AABB a = rb_bone_aabb(&bones[i]);
+    grid->aabbs[i] = a;
+    bounds.min.x = fminf(bounds.min.x, a.min.x);
+    bounds.min.y = fminf(bounds.min.y, a.min.y);
+    bounds.max.x = fmaxf(bounds.max.x, a.max.x);
+    bounds.max.y = fmaxf(bounds.max.y, a.max.y);
+  }
+
+  grid->min_x = grid_cell(bounds.min.x, grid->cell_size);
+  grid->min_y = grid_cell(bounds.min.y, grid->cell_size);
+  grid->cols = grid_cell(bounds.max.x, grid->cell_size) - grid->min_x + 1;
+  grid->rows = grid_cell(bounds.max.y, grid->cell_size) - grid->min_y + 1;
+
+  size_t cells = (size_t)grid->cols * grid->rows;
+  grid->cell_start = realloc(grid->cell_start, (cells + 1) * sizeof(uint32_t));
+  memset(grid->cell_start, 0, (cells + 1) * sizeof(uint32_t));
+
+  size_t total = 0;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t i = 0; i < bones_count; ++i) {
+      const RB_AABB *a = &grid->aabbs[i];
+      int x0 = grid_cell(a->min.x, grid->cell_size) - grid->min_x;
+      int x1 = grid_cell(a->max.x, grid->cell_size) - grid->min_x;
+      int y0 = grid_cell(a->min.y, grid->cell_size) - grid->min_y;
+      int y1 = grid_cell(a->max.y, grid->cell_size) - grid->min_y;
+      for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+          size_t cell = (size_t)y * grid->cols + x;
+          if (pass == 0) {
+            grid->cell_start[cell + 1]++;
+            total++;
+          } else {
+            grid->cell_items[grid->cell_start[cell]++] = (uint32_t)i;
+          }
+        }
+      }
+    }
+    if (pass == 0) {
+      for (size_t c = 0; c < cells; ++c) {
+        grid->cell_start[c + 1] += grid->cell_start[c];
+      }
+      if (total > grid->items_capacity) {
+        grid->items_capacity = total;
+        grid->cell_items =
+            realloc(grid->cell_items, total * sizeof(uint32_t));
+      }
+    }
+  }
+  // The fill pass advanced every start to the next cell's start; shift back.
+  memmove(grid->cell_start + 1, grid->cell_start, cells * sizeof(uint32_t));
+  grid->cell_start[0] = 0;
+
+  for (size_t c = 0; c < cells; ++c) {
+    int cx = (int)(c % grid->cols);
+    int cy = (int)(c / grid->cols);
+    for (uint32_t i = grid->cell_start[c]; i < grid->cell_start[c + 1]; ++i) {
+      for (uint32_t j = i + 1; j < grid->cell_start[c + 1]; ++j) {
+        uint32_t a = grid->cell_items[i];
+        uint32_t b = grid->cell_items[j];
+        const RB_AABB *aa = &grid->aabbs[a];
+        const RB_AABB *bb = &grid->aabbs[b];
+        if (!rb_aabb_overlap(aa, bb)) {
+          continue;
+        }
+        int ox = grid_cell(fmaxf(aa->min.x, bb->min.x), grid->cell_size) -
+                 grid->min_x;
+        int oy = grid_cell(fmaxf(aa->min.y, bb->min.y), grid->cell_size) -
+                 grid->min_y;
+        if (ox != cx || oy != cy) {
+          continue;
+        }
+        if (bones[a].joint1 == &bones[b] || bones[a].joint2 == &bones[b]) {
+          continue;
+        }
+        if (pairs->count == pairs->capacity) {
+          pairs->capacity = pairs->capacity ? pairs->capacity * 2 : 256;
+          pairs->pairs =
+              realloc(pairs->pairs, pairs->capacity * sizeof(RB_Pair));
+        }
+        pairs->pairs[pairs->count].a = a < b ? a : b;
+        pairs->pairs[pairs->count].b = a < b ? b : a;
+        pairs->count++;
+      }
+    }
+  }
+  return pairs->count;
+}
+
+static void run(size_t chains, float width)
+{
+  size_t bones_count = chains * CHAIN_BONES;
+  RB_Bone *bones = malloc(bones_count * sizeof(RB_Bone));
+
+  RB_SweepAndPrune sap;
+  rb_sap_init(&sap);
+  RB_PairBuffer sap_pairs = {0};
+
+  Grid grid = {.cell_size = BONE_LENGTH * 2};
+  RB_PairBuffer grid_pairs = {0};
+
+  double sap_time = 0;
+  double grid_time = 0;
+  size_t sap_total = 0;
+  size_t grid_total = 0;
+
+  build_scene(bones, chains, width);
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    step_scene(bones, bones_count);
+
+    double t0 = now_seconds();
+    sap_total += rb_sap_update(&sap, bones, bones_count, &sap_pairs);
+    double t1 = now_seconds();
+    grid_total += grid_update(&grid, bones, bones_count, &grid_pairs);
+    double t2 = now_seconds();
+
+    sap_time += t1 - t0;
+    grid_time += t2 - t1;
+  }
+
+  printf("%8zu bones | sap %8.3f ms/frame | grid %8.3f ms/frame | "
+         "pairs %zu/%zu\n",
+         bones_count, sap_time * 1e3 / FRAMES, grid_time * 1e3 / FRAMES,
+         sap_total, grid_total);
+
+  rb_sap_free(&sap);
+  rb_pair_buffer_free(&sap_pairs);
+  rb_pair_buffer_free(&grid_pairs);
+  free(grid.cell_start);
+  free(grid.cell_items);
+  free(grid.aabbs);
+  free(bones);
+}
+
+int main(void)
+{
+  rb_init_config(0);
+
+  run(200, 2000);
+  run(2000, 20000);
+  run(20000, 200000);
+  return 0;
+}
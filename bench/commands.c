@@ -0,0 +1,220 @@
+#include "rigidbodylib.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Producer threads push impulses and spawns into a world's command queue
+// while the main thread keeps stepping it. Each spawn carries its
+// producer and sequence number in its pinned joints, so afterwards the
+// spawned bones show whether every command arrived exactly once and in
+// push order. A second part pushes the same commands from one thread
+// between steps and checks that draining them gives the same state as
+// applying them directly.
+
+#define CHAIN_BONES 5
+#define BONE_LENGTH 20
+#define CHAINS 2000
+#define BONES (CHAINS * CHAIN_BONES)
+#define PRODUCERS 4
+#define SPAWNS 20000 // per producer
+#define QUEUE_CAPACITY 1024
+#define FRAMES 120
+#define DT (1.0f / 60.0f)
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void build_scene(RB_Bone *bones)
+{
+  for (size_t c = 0; c < CHAINS; ++c) {
+    RB_Bone *chain = &bones[c * CHAIN_BONES];
+    float x = (float)(c % 100) * 100;
+    float y = (float)(c / 100) * 100;
+
+    for (size_t i = 0; i < CHAIN_BONES; ++i) {
+      memset(&chain[i], 0, sizeof(RB_Bone));
+      chain[i].joint1_mass = 1;
+      chain[i].joint2_mass = 1;
+      chain[i].joint2_pos.x = x + (i + 1) * BONE_LENGTH;
+      chain[i].joint2_pos.y = y;
+    }
+    chain[0].joint1_mass = 0;
+    chain[0].joint1_pos.x = x;
+    chain[0].joint1_pos.y = y;
+    chain[0].length =
+        rb_calculate_distance(&chain[0].joint1_pos, &chain[0].joint2_pos);
+    for (size_t i = 1; i < CHAIN_BONES; ++i) {
+      rb_connect_bone(&chain[i - 1], &chain[i]);
+    }
+  }
+}
+
+static uint64_t bones_hash(const RB_Bone *bones, size_t count)
+{
+  uint64_t hash = 1469598103934665603ull;
+  for (size_t i = 0; i < count; ++i) {
+    const RB_Vector2 v[4] = {bones[i].joint1_pos, bones[i].joint2_pos,
+                             bones[i].joint1_velocity,
+                             bones[i].joint2_velocity};
+    const unsigned char *bytes = (const unsigned char *)v;
+    for (size_t j = 0; j < sizeof(v); ++j) {
+      hash = (hash ^ bytes[j]) * 1099511628211ull;
+    }
+  }
+  return hash;
+}
+
+typedef struct {
+  RB_CommandQueue *queue;
+  int id;
+  size_t retries;
+  double push_seconds;
+} Producer;
+
+static void *producer_main(void *arg)
+{
+  Producer *producer = arg;
+  RB_Bone spawn;
+  memset(&spawn, 0, sizeof(spawn));
+  spawn.joint1_pos.x = (float)producer->id;
+
+  double t0 = now_seconds();
+  for (int seq = 0; seq < SPAWNS; ++seq) {
+    // One kick into a chain end and one tagged spawn per round.
+    uint32_t bone = (uint32_t)((seq * 7 + producer->id) % CHAINS *
+                               CHAIN_BONES + CHAIN_BONES - 1);
+    RB_Vector2 impulse = {(float)(seq % 5) - 2, -1};
+    while (rb_command_impulse(producer->queue, bone, 2, impulse) != 0) {
+      producer->retries++;
+      sched_yield(); // full, let the stepping thread drain
+    }
+    spawn.joint2_pos.x = (float)seq;
+    while (rb_command_spawn(producer->queue, &spawn, UINT32_MAX) != 0) {
+      producer->retries++;
+      sched_yield(); // full, let the stepping thread drain
+    }
+  }
+  producer->push_seconds = now_seconds() - t0;
+  return 0;
+}
+
+// Commands pushed from one thread between steps, the same ones each run.
+static void push_frame(RB_CommandQueue *queue, RB_Bone *bones, int frame)
+{
+  for (int i = 0; i < 16; ++i) {
+    uint32_t bone = (uint32_t)((frame * 16 + i) % BONES);
+    RB_Vector2 impulse = {(float)(i - 8), (float)(frame % 3)};
+    if (queue) {
+      rb_command_impulse(queue, bone, 2, impulse);
+    } else {
+      rb_apply_impulse(&bones[bone], 2, impulse);
+    }
+  }
+  if (frame % 10 == 5) {
+    // Move a chain tail over to the next chain.
+    uint32_t chain = (uint32_t)(frame / 10 % (CHAINS - 1));
+    uint32_t child = chain * CHAIN_BONES + CHAIN_BONES - 1;
+    uint32_t parent = (chain + 1) * CHAIN_BONES + CHAIN_BONES - 2;
+    if (queue) {
+      rb_command_connect(queue, parent, child);
+    } else {
+      RB_Bone *old = bones[child].joint1;
+      if (old && old->joint2 == &bones[child]) {
+        old->joint2 = 0;
+      }
+      RB_Bone *previous = bones[parent].joint2;
+      if (previous && previous != &bones[child] &&
+          previous->joint1 == &bones[parent]) {
+        previous->joint1 = 0;
+      }
+      rb_connect_bone(&bones[parent], &bones[child]);
+    }
+  }
+}
+
+int main(void)
+{
+  rb_init_config(0);
+
+  size_t capacity = BONES + PRODUCERS * SPAWNS;
+  RB_Bone *bones = malloc(capacity * sizeof(RB_Bone));
+  RB_CommandQueue *queue = rb_command_queue_create(QUEUE_CAPACITY);
+  if (!bones || !queue) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  // Concurrent producers against a stepping world.
+  RB_World world;
+  build_scene(bones);
+  rb_world_init(&world, bones, BONES);
+  world.bones_capacity = capacity;
+  world.commands = queue;
+
+  Producer producers[PRODUCERS];
+  pthread_t threads[PRODUCERS];
+  for (int p = 0; p < PRODUCERS; ++p) {
+    producers[p] = (Producer){queue, p, 0, 0};
+    pthread_create(&threads[p], 0, producer_main, &producers[p]);
+  }
+  int steps = 0;
+  while (world.bones_count < capacity) {
+    rb_world_step(&world, DT);
+    steps++;
+  }
+  size_t retries = 0;
+  double push_seconds = 0;
+  for (int p = 0; p < PRODUCERS; ++p) {
+    pthread_join(threads[p], 0);
+    retries += producers[p].retries;
+    push_seconds += producers[p].push_seconds;
+  }
+
+  int next[PRODUCERS] = {0};
+  size_t out_of_order = 0;
+  for (size_t i = BONES; i < world.bones_count; ++i) {
+    int p = (int)bones[i].joint1_pos.x;
+    int seq = (int)bones[i].joint2_pos.x;
+    if (p < 0 || p >= PRODUCERS || seq != next[p]) {
+      out_of_order++;
+    } else {
+      next[p]++;
+    }
+  }
+
+  size_t pushed = (size_t)PRODUCERS * SPAWNS * 2;
+  printf("%d producers | %zu commands over %d steps | %6.1f ns/push | "
+         "%zu full retries | %zu spawns out of order\n",
+         PRODUCERS, pushed, steps, push_seconds * 1e9 / pushed, retries,
+         out_of_order);
+
+  // Drained commands against the same edits applied directly.
+  uint64_t hashes[2];
+  for (int run = 0; run < 2; ++run) {
+    build_scene(bones);
+    rb_world_init(&world, bones, BONES);
+    world.commands = run ? queue : 0;
+    for (int frame = 0; frame < FRAMES; ++frame) {
+      push_frame(world.commands, bones, frame);
+      rb_world_step(&world, DT);
+    }
+    hashes[run] = bones_hash(bones, BONES);
+  }
+  printf("%d bones, %d frames | direct %016llx | queued %016llx | %s\n",
+         BONES, FRAMES, (unsigned long long)hashes[0],
+         (unsigned long long)hashes[1],
+         hashes[0] == hashes[1] ? "match" : "MISMATCH");
+
+  rb_command_queue_destroy(queue);
+  free(bones);
+  return out_of_order || hashes[0] != hashes[1] ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+#include "rigidbodylib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Render extraction of a large scene: the per bone copy the examples did
+// into raylib style vectors, against rb_extract_vertices on the calling
+// thread and through the work-stealing scheduler. All three have to agree.
+
+#define BONES 100000
+#define ROUNDS 200
+
+typedef struct {
+  float x;
+  float y;
+} Vector2;
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void build_scene(RB_Bone *bones)
+{
+  srand(99);
+  for (size_t i = 0; i < BONES; ++i) {
+    memset(&bones[i], 0, sizeof(RB_Bone));
+    bones[i].joint1_pos.x = (RB_Scalar)(rand() % 8000) / 10;
+    bones[i].joint1_pos.y = (RB_Scalar)(rand() % 4500) / 10;
+    bones[i].joint2_pos.x = bones[i].joint1_pos.x + 20;
+    bones[i].joint2_pos.y = bones[i].joint1_pos.y;
+    bones[i].joint1_mass = (RB_Scalar)(i % 3);
+    bones[i].joint2_mass = 1;
+  }
+}
+
+// What each example's draw_bone did before drawing.
+static void copy_per_bone(const RB_Bone *bones, Vector2 *lines, float *masses)
+{
+  for (size_t i = 0; i < BONES; ++i) {
+    Vector2 joint1_pos = {bones[i].joint1_pos.x, bones[i].joint1_pos.y};
+    Vector2 joint2_pos = {bones[i].joint2_pos.x, bones[i].joint2_pos.y};
+    lines[i * 2] = joint1_pos;
+    lines[i * 2 + 1] = joint2_pos;
+    masses[i * 2] = bones[i].joint1_mass;
+    masses[i * 2 + 1] = bones[i].joint2_mass;
+  }
+}
+
+int main(void)
+{
+  RB_Bone *bones = malloc(BONES * sizeof(RB_Bone));
+  Vector2 *lines = malloc(BONES * 2 * sizeof(Vector2));
+  float *masses = malloc(BONES * 2 * sizeof(float));
+  RB_RenderVertex *serial = malloc(BONES * 2 * sizeof(RB_RenderVertex));
+  RB_RenderVertex *parallel = malloc(BONES * 2 * sizeof(RB_RenderVertex));
+  if (!bones || !lines || !masses || !serial || !parallel) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  build_scene(bones);
+
+  double t0 = now_seconds();
+  for (int r = 0; r < ROUNDS; ++r) {
+    copy_per_bone(bones, lines, masses);
+    __asm__ volatile("" ::: "memory"); // keep every round
+  }
+  double per_bone = now_seconds() - t0;
+
+  t0 = now_seconds();
+  for (int r = 0; r < ROUNDS; ++r) {
+    rb_extract_vertices(bones, BONES, serial);
+  }
+  double extract = now_seconds() - t0;
+
+  RB_Scheduler *scheduler = rb_scheduler_create(0);
+  RB_JobSystem jobs = rb_scheduler_job_system(scheduler);
+  rb_set_job_system(&jobs);
+  t0 = now_seconds();
+  for (int r = 0; r < ROUNDS; ++r) {
+    rb_extract_vertices(bones, BONES, parallel);
+  }
+  double scheduled = now_seconds() - t0;
+  rb_set_job_system(0);
+  rb_scheduler_destroy(scheduler);
+
+  size_t bad = 0;
+  for (size_t i = 0; i < BONES * 2; ++i) {
+    bad += serial[i].x != lines[i].x || serial[i].y != lines[i].y ||
+           serial[i].mass != masses[i] ||
+           memcmp(&serial[i], &parallel[i], sizeof(RB_RenderVertex)) != 0;
+  }
+
+  printf("%d bones | per bone copy %6.1f us | extract %6.1f us | "
+         "scheduled %6.1f us | %zu mismatches\n",
+         BONES, per_bone * 1e6 / ROUNDS, extract * 1e6 / ROUNDS,
+         scheduled * 1e6 / ROUNDS, bad);
+
+  free(parallel);
+  free(serial);
+  free(masses);
+  free(lines);
+  free(bones);
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+#include "rigidbodylib.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Steps the same set of swinging chains with the float kernels and the
+// Q16.16 kernels and reports throughput and how far the results drift.
+
+#define CHAIN_BONES 5
+#define BONE_LENGTH 20
+#define FRAMES 200
+#define DT (1.0f / 60.0f)
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void build_scene(RB_Bone *bones, size_t chains)
+{
+  srand(4321);
+  for (size_t c = 0; c < chains; ++c) {
+    RB_Bone *chain = &bones[c * CHAIN_BONES];
+    float x = (float)(c % 100) * 100;
+    float y = (float)(c / 100 % 100) * 100;
+
+    for (size_t i = 0; i < CHAIN_BONES; ++i) {
+      memset(&chain[i], 0, sizeof(RB_Bone));
+      chain[i].joint1_mass = 1;
+      chain[i].joint2_mass = 1;
+      chain[i].joint2_pos.x = x + (i + 1) * BONE_LENGTH;
+      chain[i].joint2_pos.y = y;
+    }
+    // Pin the first joint so the chains swing instead of falling away.
+    chain[0].joint1_mass = 0;
+    chain[0].joint1_pos.x = x;
+    chain[0].joint1_pos.y = y;
+    chain[0].length =
+        rb_calculate_distance(&chain[0].joint1_pos, &chain[0].joint2_pos);
+    for (size_t i = 1; i < CHAIN_BONES; ++i) {
+      rb_connect_bone(&chain[i - 1], &chain[i]);
+    }
+    chain[CHAIN_BONES - 1].joint2_velocity.y = (float)(rand() % 200 - 100);
+  }
+}
+
+static void run(size_t chains)
+{
+  size_t bones_count = chains * CHAIN_BONES;
+  RB_Bone *bones = malloc(bones_count * sizeof(RB_Bone));
+  RB_Bone *converted = malloc(bones_count * sizeof(RB_Bone));
+  RB_FxBone *fx_bones = malloc(bones_count * sizeof(RB_FxBone));
+
+  build_scene(bones, chains);
+  if (rb_fx_from_bones(bones, bones_count, fx_bones) != 0) {
+    fprintf(stderr, "bad links\n");
+    exit(1);
+  }
+  RB_Fixed fx_dt = rb_fx_from_scalar(DT);
+
+  double t0 = now_seconds();
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    rb_update_bones(bones, bones_count, DT);
+  }
+  double t1 = now_seconds();
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    rb_fx_update_bones(fx_bones, bones_count, fx_dt);
+  }
+  double t2 = now_seconds();
+
+  rb_fx_to_bones(fx_bones, bones_count, converted);
+  double max_error = 0;
+  for (size_t i = 0; i < bones_count; ++i) {
+    double error = rb_calculate_distance(&bones[i].joint2_pos,
+                                         &converted[i].joint2_pos);
+    if (error > max_error) {
+      max_error = error;
+    }
+  }
+
+  double steps = (double)bones_count * FRAMES;
+  printf("%8zu bones | float %6.2f ns/bone | q16.16 %6.2f ns/bone | "
+         "max drift %.3f\n",
+         bones_count, (t1 - t0) * 1e9 / steps, (t2 - t1) * 1e9 / steps,
+         max_error);
+
+  free(bones);
+  free(converted);
+  free(fx_bones);
+}
+
+int main(void)
+{
+  rb_init_config(0);
+
+  run(200);
+  run(2000);
+  run(20000);
+  return 0;
+}
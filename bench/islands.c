@@ -0,0 +1,145 @@
+#include "rigidbodylib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Hanging chains, a few of them thrown around. Compares stepping the
+// whole world with the substep count the fastest chain needs against
+// per island substep counts, and checks that islands step exactly like
+// rb_update_bones while everything is calm.
+
+#define CHAIN_BONES 5
+#define BONE_LENGTH 20
+#define FRAMES 120
+#define DT (1.0f / 60.0f)
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void build_scene(RB_Bone *bones, size_t chains, size_t hot_every)
+{
+  for (size_t c = 0; c < chains; ++c) {
+    RB_Bone *chain = &bones[c * CHAIN_BONES];
+    float x = (float)(c % 100) * 100;
+    float y = (float)(c / 100 % 100) * 150;
+
+    for (size_t i = 0; i < CHAIN_BONES; ++i) {
+      memset(&chain[i], 0, sizeof(RB_Bone));
+      chain[i].joint1_mass = 1;
+      chain[i].joint2_mass = 1;
+      chain[i].joint2_pos.x = x;
+      chain[i].joint2_pos.y = y + (i + 1) * BONE_LENGTH;
+    }
+    chain[0].joint1_mass = 0;
+    chain[0].joint1_pos.x = x;
+    chain[0].joint1_pos.y = y;
+    chain[0].length =
+        rb_calculate_distance(&chain[0].joint1_pos, &chain[0].joint2_pos);
+    for (size_t i = 1; i < CHAIN_BONES; ++i) {
+      rb_connect_bone(&chain[i - 1], &chain[i]);
+    }
+    if (hot_every && c % hot_every == 0) {
+      chain[CHAIN_BONES - 1].joint2_velocity.x = 3000;
+    }
+  }
+}
+
+static uint32_t max_substeps(const RB_Islands *islands)
+{
+  uint8_t level = 0;
+  for (size_t k = 0; k < islands->count; ++k) {
+    if (islands->level[k] > level) {
+      level = islands->level[k];
+    }
+  }
+  return 1u << level;
+}
+
+static void run(size_t chains, size_t hot_every)
+{
+  size_t bones_count = chains * CHAIN_BONES;
+  RB_Bone *bones = malloc(bones_count * sizeof(RB_Bone));
+  RB_Islands islands;
+  if (!bones || rb_islands_init(&islands, bones_count) != 0) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+
+  // Global substeps: every frame takes the count of the fastest island.
+  build_scene(bones, chains, hot_every);
+  rb_islands_build(&islands, bones, bones_count);
+  uint64_t global_steps = 0;
+  double t0 = now_seconds();
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    rb_plan_islands(&islands, bones, DT);
+    uint32_t substeps = max_substeps(&islands);
+    for (uint32_t s = 0; s < substeps; ++s) {
+      rb_update_bones(bones, bones_count, DT / (float)substeps);
+    }
+    global_steps += substeps * bones_count;
+  }
+  double global = now_seconds() - t0;
+
+  build_scene(bones, chains, hot_every);
+  rb_islands_build(&islands, bones, bones_count);
+  t0 = now_seconds();
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    rb_update_islands(&islands, bones, DT);
+  }
+  double multirate = now_seconds() - t0;
+
+  printf("%8zu bones | %5zu islands | hot 1/%-4zu | global %7.2f ms "
+         "(%5.1f substeps/bone) | islands %7.2f ms | %.1fx\n",
+         bones_count, islands.count, hot_every, global * 1e3,
+         (double)global_steps / ((double)bones_count * FRAMES),
+         multirate * 1e3, global / multirate);
+
+  rb_islands_free(&islands);
+  free(bones);
+}
+
+static void check_calm(size_t chains)
+{
+  size_t bones_count = chains * CHAIN_BONES;
+  RB_Bone *bones = malloc(bones_count * sizeof(RB_Bone));
+  RB_Islands islands;
+  if (!bones || rb_islands_init(&islands, bones_count) != 0) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+
+  build_scene(bones, chains, 0);
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    rb_update_bones(bones, bones_count, DT);
+  }
+  uint64_t expected = rb_state_hash(bones, bones_count);
+
+  build_scene(bones, chains, 0);
+  rb_islands_build(&islands, bones, bones_count);
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    rb_update_islands(&islands, bones, DT);
+  }
+  printf("calm scene: islands %s rb_update_bones\n",
+         rb_state_hash(bones, bones_count) == expected ? "match"
+                                                       : "DO NOT MATCH");
+
+  rb_islands_free(&islands);
+  free(bones);
+}
+
+int main(void)
+{
+  rb_init_config(0);
+
+  check_calm(1000);
+  for (size_t chains = 200; chains <= 20000; chains *= 10) {
+    run(chains, 100);
+    run(chains, 10);
+  }
+  return 0;
+}
@@ -0,0 +1,371 @@
+#include "rigidbodylib.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Islands from 2 to 2000 bones, a few of them thrown around, stepped on
+// the calling thread, with the work-stealing scheduler at a few thread
+// counts and through a plain mutex and queue pool standing in for an
+// engine's job system. The results have to match bit for bit.
+//
+// A stress part then runs parallel_for three levels deep from more
+// threads outside the pool than it has outside deques and checks that
+// every item ran exactly once. Another outside thread then has to finish
+// a parallel_for while one is stuck inside its own. Build with
+// -fsanitize=thread to check the scheduler.
+
+#define TOTAL_BONES 200000
+#define BONE_LENGTH 20
+#define FRAMES 60
+#define DT (1.0f / 60.0f)
+#define POOL_THREADS 4
+#define POOL_QUEUE 4096
+
+#define NEST_OUTER 16
+#define NEST_MIDDLE 16
+#define NEST_INNER 64
+#define NEST_ITEMS (NEST_OUTER * NEST_MIDDLE * NEST_INNER)
+#define NEST_CALLERS 10
+#define NEST_ROUNDS 50
+#define HOLD_SECONDS 2.0
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Mostly short chains with a long tail, like ragdolls next to ropes.
+static size_t build_scene(RB_Bone *bones)
+{
+  srand(7);
+  size_t count = 0;
+  size_t chain = 0;
+  while (count < TOTAL_BONES) {
+    size_t length = rand() % 50 == 0 ? 500 + rand() % 1501 : 2 + rand() % 14;
+    if (length > TOTAL_BONES - count) {
+      length = TOTAL_BONES - count;
+    }
+    float x = (float)(chain % 300) * 60;
+    float y = (float)(chain / 300) * 60;
+    RB_Bone *c = &bones[count];
+
+    for (size_t i = 0; i < length; ++i) {
+      memset(&c[i], 0, sizeof(RB_Bone));
+      c[i].joint1_mass = 1;
+      c[i].joint2_mass = 1;
+      c[i].joint2_pos.x = x + (i + 1) * BONE_LENGTH;
+      c[i].joint2_pos.y = y;
+    }
+    c[0].joint1_mass = 0;
+    c[0].joint1_pos.x = x;
+    c[0].joint1_pos.y = y;
+    c[0].length = rb_calculate_distance(&c[0].joint1_pos, &c[0].joint2_pos);
+    for (size_t i = 1; i < length; ++i) {
+      rb_connect_bone(&c[i - 1], &c[i]);
+    }
+    if (chain % 20 == 0) {
+      c[length - 1].joint2_velocity.y = 2000;
+    }
+    count += length;
+    chain++;
+  }
+  return count;
+}
+
+// The engine side: a fixed queue of ranges under one lock, workers that
+// block on it, and a wait that helps until the outstanding count drops
+// to zero. Only ever used from one submitting thread.
+typedef struct {
+  RB_TaskFn fn;
+  void *data;
+  uint32_t begin;
+  uint32_t end;
+} PoolTask;
+
+typedef struct {
+  pthread_t threads[POOL_THREADS];
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  PoolTask tasks[POOL_QUEUE];
+  size_t head;
+  size_t tail;
+  uint32_t outstanding;
+  int stop;
+} Pool;
+
+static int pool_run_one(Pool *pool)
+{
+  if (pool->head == pool->tail) {
+    return 0;
+  }
+  PoolTask task = pool->tasks[pool->head++ % POOL_QUEUE];
+  pthread_mutex_unlock(&pool->lock);
+  task.fn(task.data, task.begin, task.end);
+  pthread_mutex_lock(&pool->lock);
+  if (--pool->outstanding == 0) {
+    pthread_cond_broadcast(&pool->done);
+  }
+  return 1;
+}
+
+static void *pool_main(void *arg)
+{
+  Pool *pool = arg;
+  pthread_mutex_lock(&pool->lock);
+  while (!pool->stop) {
+    if (!pool_run_one(pool)) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+static void pool_enqueue(void *context, RB_TaskFn fn, void *data,
+                         uint32_t begin, uint32_t end, uint32_t grain)
+{
+  Pool *pool = context;
+  pthread_mutex_lock(&pool->lock);
+  for (uint32_t first = begin; first < end; first += grain) {
+    if (pool->tail - pool->head == POOL_QUEUE) {
+      pthread_mutex_unlock(&pool->lock);
+      fn(data, first, end);
+      return;
+    }
+    uint32_t last = end - first > grain ? first + grain : end;
+    PoolTask task = {fn, data, first, last};
+    pool->tasks[pool->tail++ % POOL_QUEUE] = task;
+    pool->outstanding++;
+  }
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void pool_wait(void *context)
+{
+  Pool *pool = context;
+  pthread_mutex_lock(&pool->lock);
+  while (pool->outstanding > 0) {
+    if (!pool_run_one(pool)) {
+      pthread_cond_wait(&pool->done, &pool->lock);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void pool_start(Pool *pool)
+{
+  memset(pool, 0, sizeof(*pool));
+  pthread_mutex_init(&pool->lock, 0);
+  pthread_cond_init(&pool->work, 0);
+  pthread_cond_init(&pool->done, 0);
+  for (int i = 0; i < POOL_THREADS; ++i) {
+    pthread_create(&pool->threads[i], 0, pool_main, pool);
+  }
+}
+
+static void pool_stop(Pool *pool)
+{
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < POOL_THREADS; ++i) {
+    pthread_join(pool->threads[i], 0);
+  }
+}
+
+typedef struct {
+  _Atomic uint32_t *counts;
+  uint32_t first; // of the items below this task
+} NestTask;
+
+static void nest_inner(void *data, uint32_t begin, uint32_t end)
+{
+  NestTask *task = data;
+  for (uint32_t i = begin; i < end; ++i) {
+    atomic_fetch_add_explicit(&task->counts[task->first + i], 1,
+                              memory_order_relaxed);
+  }
+}
+
+static void nest_middle(void *data, uint32_t begin, uint32_t end)
+{
+  NestTask *task = data;
+  for (uint32_t i = begin; i < end; ++i) {
+    NestTask inner = {task->counts, task->first + i * NEST_INNER};
+    rb_parallel_for(nest_inner, &inner, NEST_INNER, 8);
+  }
+}
+
+static void nest_outer(void *data, uint32_t begin, uint32_t end)
+{
+  NestTask *task = data;
+  for (uint32_t i = begin; i < end; ++i) {
+    NestTask middle = {task->counts, i * NEST_MIDDLE * NEST_INNER};
+    rb_parallel_for(nest_middle, &middle, NEST_MIDDLE, 2);
+  }
+}
+
+static void *nest_caller(void *arg)
+{
+  NestTask task = {arg, 0};
+  for (int round = 0; round < NEST_ROUNDS; ++round) {
+    rb_parallel_for(nest_outer, &task, NEST_OUTER, 1);
+  }
+  return 0;
+}
+
+// Returns the number of items that did not run exactly NEST_ROUNDS times.
+static size_t run_nested(void)
+{
+  static _Atomic uint32_t counts[NEST_CALLERS][NEST_ITEMS];
+  memset(counts, 0, sizeof(counts));
+
+  pthread_t threads[NEST_CALLERS];
+  for (int c = 0; c < NEST_CALLERS; ++c) {
+    pthread_create(&threads[c], 0, nest_caller, counts[c]);
+  }
+  size_t wrong = 0;
+  for (int c = 0; c < NEST_CALLERS; ++c) {
+    pthread_join(threads[c], 0);
+    for (size_t i = 0; i < NEST_ITEMS; ++i) {
+      wrong += atomic_load(&counts[c][i]) != NEST_ROUNDS;
+    }
+  }
+  return wrong;
+}
+
+static _Atomic int hold_state; // 1 while hold_task runs, 2 releases it
+
+static void hold_task(void *data, uint32_t begin, uint32_t end)
+{
+  (void)data;
+  (void)begin;
+  (void)end;
+  double deadline = now_seconds() + HOLD_SECONDS;
+  atomic_store(&hold_state, 1);
+  while (atomic_load(&hold_state) != 2 && now_seconds() < deadline) {
+    sched_yield();
+  }
+}
+
+static void *hold_caller(void *arg)
+{
+  (void)arg;
+  rb_parallel_for(hold_task, 0, 1, 1);
+  return 0;
+}
+
+static void count_task(void *data, uint32_t begin, uint32_t end)
+{
+  atomic_fetch_add((_Atomic uint32_t *)data, end - begin);
+}
+
+// Seconds a parallel_for takes while another outside thread is inside
+// one that only ends once this one is done (or after HOLD_SECONDS), like
+// a render thread next to an rb_async_step thread.
+static double run_beside(void)
+{
+  static _Atomic uint32_t items;
+  atomic_store(&items, 0);
+  atomic_store(&hold_state, 0);
+
+  pthread_t thread;
+  pthread_create(&thread, 0, hold_caller, 0);
+  while (atomic_load(&hold_state) != 1) {
+    sched_yield();
+  }
+  double t0 = now_seconds();
+  rb_parallel_for(count_task, &items, 1000, 10);
+  double seconds = now_seconds() - t0;
+  atomic_store(&hold_state, 2);
+  pthread_join(thread, 0);
+  return atomic_load(&items) == 1000 ? seconds : HOLD_SECONDS;
+}
+
+static double run(RB_Bone *bones, RB_Islands *islands, uint64_t *hash)
+{
+  size_t count = build_scene(bones);
+  rb_islands_build(islands, bones, count);
+
+  double t0 = now_seconds();
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    rb_update_islands(islands, bones, DT);
+  }
+  double seconds = now_seconds() - t0;
+  *hash = rb_state_hash(bones, count);
+  return seconds;
+}
+
+int main(void)
+{
+  rb_init_config(0);
+
+  RB_Bone *bones = malloc(TOTAL_BONES * sizeof(RB_Bone));
+  RB_Islands islands;
+  if (!bones || rb_islands_init(&islands, TOTAL_BONES) != 0) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  uint64_t expected;
+  int failed = 0;
+  double serial = run(bones, &islands, &expected);
+  printf("%zu islands, %ld cpus\n", islands.count,
+         sysconf(_SC_NPROCESSORS_ONLN));
+  printf("calling thread | %8.2f ms/frame\n", serial * 1e3 / FRAMES);
+
+  for (int threads = 1; threads <= 8; threads *= 2) {
+    RB_Scheduler *scheduler = rb_scheduler_create(threads);
+    RB_JobSystem jobs = rb_scheduler_job_system(scheduler);
+    rb_set_job_system(&jobs);
+
+    uint64_t hash;
+    double seconds = run(bones, &islands, &hash);
+    printf("%2d threads     | %8.2f ms/frame | %.2fx | %s\n", threads,
+           seconds * 1e3 / FRAMES, serial / seconds,
+           hash == expected ? "match" : "MISMATCH");
+    failed |= hash != expected;
+
+    double t0 = now_seconds();
+    size_t wrong = run_nested();
+    printf("   nested      | %8.2f ms | %d callers x %d rounds | %zu items "
+           "wrong\n",
+           (now_seconds() - t0) * 1e3, NEST_CALLERS, NEST_ROUNDS, wrong);
+    failed |= wrong != 0;
+
+    double beside = run_beside();
+    printf("   beside      | %8.2f ms | %s\n", beside * 1e3,
+           beside < HOLD_SECONDS ? "independent" : "BLOCKED");
+    failed |= beside >= HOLD_SECONDS;
+
+    rb_set_job_system(0);
+    rb_scheduler_destroy(scheduler);
+  }
+
+  static Pool pool;
+  pool_start(&pool);
+  RB_JobSystem jobs = {&pool, pool_enqueue, pool_wait};
+  rb_set_job_system(&jobs);
+  uint64_t hash;
+  double seconds = run(bones, &islands, &hash);
+  printf("external pool  | %8.2f ms/frame | %.2fx | %s\n",
+         seconds * 1e3 / FRAMES, serial / seconds,
+         hash == expected ? "match" : "MISMATCH");
+  failed |= hash != expected;
+  rb_set_job_system(0);
+  pool_stop(&pool);
+
+  rb_islands_free(&islands);
+  free(bones);
+  return failed;
+}
@@ -0,0 +1,220 @@
+#include "rigidbodylib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Steps swinging chains with a rollback buffer attached and reports what
+// recording costs relative to the step for a few capture intervals, then
+// resimulates the last frames and checks the result matches bit for bit.
+// A last part rewinds across a spawn and checks the world steps on as if
+// the bone had never been there.
+
+#define CHAIN_BONES 5
+#define BONE_LENGTH 20
+#define FRAMES 240
+#define HISTORY_FRAMES 16
+#define REWIND 15
+#define DT (1.0f / 60.0f)
+
+#define SPAWN_CHAINS 200
+#define SPAWN_INTERVAL 4
+#define SPAWN_FRAME 13 // the spawn is drained by this frame's step
+#define SPAWN_REWIND_TO 10
+#define SPAWN_FRAMES 24
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void build_scene(RB_Bone *bones, size_t chains)
+{
+  srand(4321);
+  for (size_t c = 0; c < chains; ++c) {
+    RB_Bone *chain = &bones[c * CHAIN_BONES];
+    float x = (float)(c % 100) * 100;
+    float y = (float)(c / 100 % 100) * 100;
+
+    for (size_t i = 0; i < CHAIN_BONES; ++i) {
+      memset(&chain[i], 0, sizeof(RB_Bone));
+      chain[i].joint1_mass = 1;
+      chain[i].joint2_mass = 1;
+      chain[i].joint2_pos.x = x + (i + 1) * BONE_LENGTH;
+      chain[i].joint2_pos.y = y;
+    }
+    chain[0].joint1_mass = 0;
+    chain[0].joint1_pos.x = x;
+    chain[0].joint1_pos.y = y;
+    chain[0].length =
+        rb_calculate_distance(&chain[0].joint1_pos, &chain[0].joint2_pos);
+    for (size_t i = 1; i < CHAIN_BONES; ++i) {
+      rb_connect_bone(&chain[i - 1], &chain[i]);
+    }
+    chain[CHAIN_BONES - 1].joint2_velocity.y = (float)(rand() % 200 - 100);
+  }
+}
+
+static void run(size_t chains, uint32_t interval)
+{
+  size_t bones_count = chains * CHAIN_BONES;
+  RB_Bone *bones = malloc(bones_count * sizeof(RB_Bone));
+  RB_Rollback rollback;
+  RB_World world;
+
+  if (rb_rollback_init(&rollback, HISTORY_FRAMES / interval, bones_count,
+                       interval) != 0) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+
+  build_scene(bones, chains);
+  rb_world_init(&world, bones, bones_count);
+  world.rollback = &rollback;
+
+  // The first pass over the buffer pays for page faults, skip it.
+  for (int frame = 0; frame < HISTORY_FRAMES; ++frame) {
+    rb_world_step(&world, DT);
+  }
+
+  // rb_world_step spelled out, to time recording and stepping apart.
+  double record = 0;
+  double step = 0;
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    double t0 = now_seconds();
+    rb_rollback_record(&rollback, &world, DT);
+    double t1 = now_seconds();
+    rb_update_bones(bones, bones_count, DT);
+    world.frame++;
+    double t2 = now_seconds();
+    record += t1 - t0;
+    step += t2 - t1;
+  }
+
+  uint64_t expected = rb_state_hash(bones, bones_count);
+  double t0 = now_seconds();
+  int failed = rb_world_resimulate(&world, REWIND, 0, 0) != 0;
+  double resimulate = now_seconds() - t0;
+  int match = !failed && rb_state_hash(bones, bones_count) == expected;
+
+  double steps = (double)bones_count * FRAMES;
+  printf("%8zu bones | interval %2u | step %6.2f ns/bone | record %5.2f "
+         "ns/bone (%.2f%%) | resimulate %d frames %7.2f ms %s\n",
+         bones_count, interval, step * 1e9 / steps, record * 1e9 / steps,
+         record / step * 100, REWIND, resimulate * 1e3,
+         match ? "match" : "MISMATCH");
+
+  rb_rollback_free(&rollback);
+  free(bones);
+}
+
+// Links either empty or into the first count bones.
+static int links_in_range(const RB_Bone *bones, size_t count)
+{
+  for (size_t i = 0; i < count; ++i) {
+    const RB_Bone *joint1 = bones[i].joint1;
+    const RB_Bone *joint2 = bones[i].joint2;
+    if ((joint1 && (joint1 < bones || joint1 >= bones + count)) ||
+        (joint2 && (joint2 < bones || joint2 >= bones + count))) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Spawns a bone onto the end of the first chain through the command
+// queue, rewinds to before the spawn and steps on. The world has to lose
+// the bone, the link to it and its island, and then match a world that
+// never spawned anything, bit for bit.
+static int run_spawn(void)
+{
+  size_t bones_count = SPAWN_CHAINS * CHAIN_BONES;
+  RB_Bone *bones = malloc((bones_count + 1) * sizeof(RB_Bone));
+  RB_Bone *reference = malloc(bones_count * sizeof(RB_Bone));
+  RB_CommandQueue *commands = rb_command_queue_create(4);
+  RB_Rollback rollback;
+  RB_Islands islands;
+  RB_Islands reference_islands;
+  if (!bones || !reference || !commands ||
+      rb_rollback_init(&rollback, SPAWN_FRAMES / SPAWN_INTERVAL,
+                       bones_count + 1, SPAWN_INTERVAL) != 0 ||
+      rb_islands_init(&islands, bones_count + 1) != 0 ||
+      rb_islands_init(&reference_islands, bones_count) != 0) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+
+  build_scene(bones, SPAWN_CHAINS);
+  build_scene(reference, SPAWN_CHAINS);
+  RB_World world;
+  rb_world_init(&world, bones, bones_count);
+  world.bones_capacity = bones_count + 1;
+  world.rollback = &rollback;
+  world.islands = &islands;
+  world.commands = commands;
+  rb_islands_build(&islands, bones, bones_count);
+  RB_World plain;
+  rb_world_init(&plain, reference, bones_count);
+  plain.islands = &reference_islands;
+  rb_islands_build(&reference_islands, reference, bones_count);
+
+  RB_Bone spawn;
+  memset(&spawn, 0, sizeof(spawn));
+  spawn.joint1_mass = 1;
+  spawn.joint2_mass = 1;
+  spawn.joint2_pos.x = bones[CHAIN_BONES - 1].joint2_pos.x + BONE_LENGTH;
+  spawn.joint2_pos.y = bones[CHAIN_BONES - 1].joint2_pos.y;
+
+  for (int frame = 0; frame < SPAWN_FRAMES; ++frame) {
+    if (frame == SPAWN_FRAME) {
+      rb_command_spawn(commands, &spawn, CHAIN_BONES - 1);
+    }
+    rb_world_step(&world, DT);
+  }
+  int spawned = world.bones_count == bones_count + 1;
+
+  int failed = rb_world_rewind(&world, SPAWN_FRAMES - SPAWN_REWIND_TO, 0,
+                               0) != 0;
+  for (int frame = 0; frame < SPAWN_REWIND_TO; ++frame) {
+    rb_world_step(&plain, DT);
+  }
+  failed |= world.bones_count != bones_count ||
+            !links_in_range(bones, world.bones_count) ||
+            islands.count != reference_islands.count ||
+            rb_state_hash(bones, bones_count) !=
+                rb_state_hash(reference, bones_count);
+
+  for (int frame = SPAWN_REWIND_TO; frame < SPAWN_FRAMES; ++frame) {
+    rb_world_step(&world, DT);
+    rb_world_step(&plain, DT);
+  }
+  failed |= world.bones_count != bones_count ||
+            rb_state_hash(bones, bones_count) !=
+                rb_state_hash(reference, bones_count);
+  failed |= !spawned;
+
+  printf("%8zu bones | rewind %d frames across a spawn | %s\n", bones_count,
+         SPAWN_FRAMES - SPAWN_REWIND_TO, failed ? "MISMATCH" : "match");
+
+  rb_islands_free(&reference_islands);
+  rb_islands_free(&islands);
+  rb_rollback_free(&rollback);
+  rb_command_queue_destroy(commands);
+  free(reference);
+  free(bones);
+  return failed;
+}
+
+int main(void)
+{
+  rb_init_config(0);
+
+  for (size_t chains = 200; chains <= 20000; chains *= 10) {
+    run(chains, 1);
+    run(chains, 4);
+    run(chains, 8);
+  }
+  return run_spawn();
+}
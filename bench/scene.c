@@ -0,0 +1,71 @@
+#include "rigidbodylib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Writes a scene of many ragdoll-ish chains to a temporary file and times
+// loading it back.
+
+#define CHAIN_BONES 5
+#define BONE_LENGTH 20
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void write_scene(FILE *file, size_t chains)
+{
+  fprintf(file, "# %zu chains\nconfig gravity 200 spring 600 damping 50\n",
+          chains);
+  for (size_t c = 0; c < chains; ++c) {
+    float x = (float)(c % 100) * 100.5f;
+    float y = (float)(c / 100) * 100.25f;
+
+    fprintf(file, "bone joint1 %.2f %.2f joint2 %.2f %.2f mass 0 1\n", x, y,
+            x + BONE_LENGTH, y);
+    for (size_t i = 1; i < CHAIN_BONES; ++i) {
+      fprintf(file, "bone joint2 %.2f %.2f parent -1 velocity2 0 %.1f\n",
+              x + (i + 1) * BONE_LENGTH, y, (float)i * 1.5f);
+    }
+  }
+}
+
+static void run(size_t chains)
+{
+  size_t capacity = chains * CHAIN_BONES;
+  RB_Bone *bones = malloc(capacity * sizeof(RB_Bone));
+  FILE *file = tmpfile();
+  if (!bones || !file) {
+    fprintf(stderr, "can't create scene\n");
+    exit(1);
+  }
+
+  write_scene(file, chains);
+  long size = ftell(file);
+  rewind(file);
+
+  size_t bones_count = 0;
+  double t0 = now_seconds();
+  int result = rb_scene_load(file, bones, capacity, &bones_count);
+  double elapsed = now_seconds() - t0;
+
+  printf("%8zu bones | %7.2f MB | %7.2f ms | %6.1f ns/bone | %6.1f MB/s%s\n",
+         bones_count, size / 1e6, elapsed * 1e3, elapsed * 1e9 / bones_count,
+         size / 1e6 / elapsed, result == 0 ? "" : " | FAILED");
+
+  fclose(file);
+  free(bones);
+}
+
+int main(void)
+{
+  rb_init_config(0);
+
+  run(200);
+  run(2000);
+  run(20000);
+  return 0;
+}
@@ -0,0 +1,131 @@
+#include "rigidbodylib.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Streams a moving scene of swinging chains at 60 Hz through the delta
+// encoder and decoder, acking every frame like a viewer with a back
+// channel. Every decoded joint has to be within half a quantization step
+// of the simulated one. Reports bytes per frame and the codec time.
+
+#define CHAINS 2000
+#define CHAIN_BONES 5
+#define BONES (CHAINS * CHAIN_BONES)
+#define BONE_LENGTH 20
+#define FRAMES 600
+#define QUANTUM 0.01f
+#define DT (1.0f / 60.0f)
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void build_scene(RB_Bone *bones)
+{
+  srand(2024);
+  for (size_t c = 0; c < CHAINS; ++c) {
+    RB_Bone *chain = &bones[c * CHAIN_BONES];
+    float x = (float)(c % 50) * 20;
+    float y = (float)(c / 50) * 12;
+
+    for (size_t i = 0; i < CHAIN_BONES; ++i) {
+      memset(&chain[i], 0, sizeof(RB_Bone));
+      chain[i].joint1_mass = 1;
+      chain[i].joint2_mass = 1;
+      chain[i].joint2_pos.x = x + (i + 1) * BONE_LENGTH;
+      chain[i].joint2_pos.y = y;
+    }
+    chain[0].joint1_mass = 0;
+    chain[0].joint1_pos.x = x;
+    chain[0].joint1_pos.y = y;
+    chain[0].length =
+        rb_calculate_distance(&chain[0].joint1_pos, &chain[0].joint2_pos);
+    for (size_t i = 1; i < CHAIN_BONES; ++i) {
+      rb_connect_bone(&chain[i - 1], &chain[i]);
+    }
+    chain[CHAIN_BONES - 1].joint2_velocity.y = (float)(rand() % 200 - 100);
+  }
+}
+
+// Half a step, plus the rounding of scaling by the quantum at v.
+static int within_step(RB_Scalar decoded, RB_Scalar v)
+{
+  RB_Scalar slack = fabs(v) * FLT_EPSILON * 2;
+  return fabs(decoded - v) <= QUANTUM * 0.5f + slack;
+}
+
+int main(void)
+{
+  RB_Bone *bones = malloc(BONES * sizeof(RB_Bone));
+  RB_Vector2 *positions = malloc(BONES * 2 * sizeof(RB_Vector2));
+  size_t bound = rb_stream_encode_bound(BONES);
+  unsigned char *packet = malloc(bound);
+  RB_StreamEncoder encoder;
+  RB_StreamDecoder decoder;
+  if (!bones || !positions || !packet ||
+      rb_stream_encoder_init(&encoder, BONES, QUANTUM) != 0 ||
+      rb_stream_decoder_init(&decoder, BONES, QUANTUM) != 0) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  build_scene(bones);
+
+  size_t keyframe_bytes = 0;
+  size_t delta_bytes = 0;
+  size_t bad = 0;
+  double encode = 0;
+  double decode = 0;
+
+  for (uint32_t frame = 0; frame < FRAMES; ++frame) {
+    rb_update_bones(bones, BONES, DT);
+
+    double t0 = now_seconds();
+    size_t size = rb_stream_encode(&encoder, frame, bones, packet, bound);
+    double t1 = now_seconds();
+    uint32_t decoded_frame;
+    int result = rb_stream_decode(&decoder, packet, size, &decoded_frame,
+                                  positions);
+    double t2 = now_seconds();
+    encode += t1 - t0;
+    decode += t2 - t1;
+
+    if (size == 0 || result != 0 || decoded_frame != frame) {
+      fprintf(stderr, "frame %u: encode %zu bytes, decode %d\n", frame, size,
+              result);
+      return 1;
+    }
+    rb_stream_encoder_ack(&encoder, frame);
+
+    if (frame == 0) {
+      keyframe_bytes = size;
+    } else {
+      delta_bytes += size;
+    }
+
+    for (size_t i = 0; i < BONES; ++i) {
+      bad += !within_step(positions[i * 2].x, bones[i].joint1_pos.x) ||
+             !within_step(positions[i * 2].y, bones[i].joint1_pos.y) ||
+             !within_step(positions[i * 2 + 1].x, bones[i].joint2_pos.x) ||
+             !within_step(positions[i * 2 + 1].y, bones[i].joint2_pos.y);
+    }
+  }
+
+  printf("%d bones | raw %zu B | keyframe %zu B | delta %.0f B/frame | "
+         "encode %.1f us | decode %.1f us | %zu out of step\n",
+         BONES, (size_t)BONES * 4 * sizeof(float), keyframe_bytes,
+         (double)delta_bytes / (FRAMES - 1), encode * 1e6 / FRAMES,
+         decode * 1e6 / FRAMES, bad);
+
+  rb_stream_decoder_free(&decoder);
+  rb_stream_encoder_free(&encoder);
+  free(packet);
+  free(positions);
+  free(bones);
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+#include "rigidbodylib.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Many double pendulums, each in its own world, as in lookahead rollouts.
+// Steps them one world at a time with rb_world_step and all at once with
+// rb_step_worlds, then compares the final states.
+
+#define WORLD_BONES 2
+#define FRAMES 600
+#define DT (1.0f / 60.0f)
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void build_worlds(RB_World *worlds, RB_Bone *bones, size_t count)
+{
+  srand(99);
+  for (size_t w = 0; w < count; ++w) {
+    RB_Bone *b = &bones[w * WORLD_BONES];
+    memset(b, 0, WORLD_BONES * sizeof(RB_Bone));
+    b[0].joint1_pos.x = 400;
+    b[0].joint1_pos.y = 100;
+    b[0].joint2_pos.x = 400;
+    b[0].joint2_pos.y = 190;
+    b[0].joint2_mass = 1;
+    b[0].length = 90;
+    b[1].joint2_pos.x = 400;
+    b[1].joint2_pos.y = 280;
+    b[1].joint1_mass = 1;
+    b[1].joint2_mass = 1;
+    rb_connect_bone(&b[0], &b[1]);
+    b[1].joint2_velocity.x = (float)(rand() % 600 - 300);
+    rb_world_init(&worlds[w], b, WORLD_BONES);
+  }
+}
+
+static void run(size_t count)
+{
+  RB_World *worlds = malloc(count * sizeof(RB_World));
+  RB_Bone *bones = malloc(count * WORLD_BONES * sizeof(RB_Bone));
+  RB_Bone *expected = malloc(count * WORLD_BONES * sizeof(RB_Bone));
+  if (!worlds || !bones || !expected) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+
+  build_worlds(worlds, bones, count);
+  double t0 = now_seconds();
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    for (size_t w = 0; w < count; ++w) {
+      rb_world_step(&worlds[w], DT);
+    }
+  }
+  double single = now_seconds() - t0;
+  memcpy(expected, bones, count * WORLD_BONES * sizeof(RB_Bone));
+
+  build_worlds(worlds, bones, count);
+  t0 = now_seconds();
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    rb_step_worlds(worlds, count, DT);
+  }
+  double batched = now_seconds() - t0;
+
+  size_t matching = 0;
+  double max_diff = 0;
+  for (size_t w = 0; w < count; ++w) {
+    const RB_Bone *a = &bones[w * WORLD_BONES];
+    const RB_Bone *b = &expected[w * WORLD_BONES];
+    matching += rb_state_hash(a, WORLD_BONES) == rb_state_hash(b, WORLD_BONES);
+    for (size_t i = 0; i < WORLD_BONES; ++i) {
+      max_diff = fmax(max_diff, fabs(a[i].joint2_pos.x - b[i].joint2_pos.x));
+      max_diff = fmax(max_diff, fabs(a[i].joint2_pos.y - b[i].joint2_pos.y));
+    }
+  }
+
+  double steps = (double)count * FRAMES;
+  printf("%7zu worlds | rb_world_step %6.1f ns/world | rb_step_worlds %6.1f "
+         "ns/world | %.1fx | %zu/%zu bit exact, max diff %g\n",
+         count, single * 1e9 / steps, batched * 1e9 / steps, single / batched,
+         matching, count, max_diff);
+
+  free(expected);
+  free(bones);
+  free(worlds);
+}
+
+int main(void)
+{
+  rb_init_config(0);
+
+  for (size_t count = 100; count <= 100000; count *= 10) {
+    run(count);
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+#include "bone_renderer.h"
+#include "rlgl.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define JOINT_SEGMENTS 16 // triangles per joint circle
+
+int bone_renderer_init(BoneRenderer *renderer, size_t capacity)
+{
+  renderer->vertices = malloc(capacity * 2 * sizeof(RB_RenderVertex));
+  renderer->capacity = capacity;
+  renderer->line_width = 2;
+  renderer->joint_radius = 3;
+  renderer->line_color = WHITE;
+  renderer->joint_color = RED;
+  renderer->pinned_color = BLUE;
+  return renderer->vertices || !capacity ? 0 : -1;
+}
+
+void bone_renderer_free(BoneRenderer *renderer)
+{
+  free(renderer->vertices);
+  renderer->vertices = 0;
+  renderer->capacity = 0;
+}
+
+void bone_renderer_draw(BoneRenderer *renderer, const RB_Bone *bones,
+                        size_t bones_count)
+{
+  if (bones_count > renderer->capacity) {
+    bones_count = renderer->capacity;
+  }
+  const RB_RenderVertex *v = renderer->vertices;
+  size_t count = bones_count * 2;
+  rb_extract_vertices(bones, bones_count, renderer->vertices);
+
+  // Wide lines are not available on every GL profile, those draw 1 pixel.
+  Color c = renderer->line_color;
+  rlDrawRenderBatchActive(); // the width applies to the whole batch
+  rlSetLineWidth(renderer->line_width);
+  rlBegin(RL_LINES);
+  rlColor4ub(c.r, c.g, c.b, c.a);
+  for (size_t i = 0; i < count; ++i) {
+    rlVertex2f(v[i].x, v[i].y);
+  }
+  rlEnd();
+  rlDrawRenderBatchActive();
+  rlSetLineWidth(1);
+
+  // Joints as circles, a fan of triangles each like raylib's DrawCircleV,
+  // all in one triangle list.
+  float unit_x[JOINT_SEGMENTS + 1];
+  float unit_y[JOINT_SEGMENTS + 1];
+  for (int s = 0; s <= JOINT_SEGMENTS; ++s) {
+    float angle = 2 * PI * s / JOINT_SEGMENTS;
+    unit_x[s] = cosf(angle);
+    unit_y[s] = sinf(angle);
+  }
+  rlBegin(RL_TRIANGLES);
+  for (size_t i = 0; i < count; ++i) {
+    // Whole pixel radii as the examples used to draw them, so joints
+    // too light for one pixel show like pinned ones.
+    float r = (int)(renderer->joint_radius * v[i].mass);
+    Color color = renderer->joint_color;
+    if (r == 0) {
+      r = renderer->joint_radius;
+      color = renderer->pinned_color;
+    }
+    rlColor4ub(color.r, color.g, color.b, color.a);
+    for (int s = 0; s < JOINT_SEGMENTS; ++s) {
+      rlVertex2f(v[i].x, v[i].y);
+      rlVertex2f(v[i].x + unit_x[s + 1] * r, v[i].y + unit_y[s + 1] * r);
+      rlVertex2f(v[i].x + unit_x[s] * r, v[i].y + unit_y[s] * r);
+    }
+  }
+  rlEnd();
+}
@@ -0,0 +1,31 @@
+#ifndef BONE_RENDERER_H
+#define BONE_RENDERER_H
+
+#include "raylib.h"
+#include "rigidbodylib.h"
+
+// Draws bones as one line list and one triangle list through the rlgl batch
+// instead of a DrawLineEx and two DrawCircleV per bone. rlgl only issues
+// a draw call when its batch fills up, so even 100k bones take a handful.
+// Joints whose radius truncates to 0 (pinned or very light) are drawn in
+// pinned_color at joint_radius, like the examples always did.
+typedef struct {
+  RB_RenderVertex *vertices; // 2 per bone, filled by rb_extract_vertices
+  size_t capacity;           // bones
+  float line_width;
+  float joint_radius; // per unit of mass, truncated to whole pixels
+  Color line_color;
+  Color joint_color;
+  Color pinned_color;
+} BoneRenderer;
+
+// Returns 0 on success, -1 on allocation failure.
+int bone_renderer_init(BoneRenderer *renderer, size_t capacity);
+void bone_renderer_free(BoneRenderer *renderer);
+
+// Call between BeginDrawing and EndDrawing. Bones past capacity are not
+// drawn.
+void bone_renderer_draw(BoneRenderer *renderer, const RB_Bone *bones,
+                        size_t bones_count);
+
+#endif // BONE_RENDERER_H
@@ -1,3 +1,4 @@
+#include "bone_renderer.h"
 #include "raylib.h"
 #include "rigidbodylib.h"
 #include <math.h>
@@ -50,26 +51,6 @@ void detect_ground_collision(RB_Bone *bone)
   }
 }
 
-void draw_bone(RB_Bone *bone)
-{
-  Vector2 joint1_pos = {bone->joint1_pos.x, bone->joint1_pos.y};
-  Vector2 joint2_pos = {bone->joint2_pos.x, bone->joint2_pos.y};
-  DrawLineEx(joint1_pos, joint2_pos, 2, WHITE);
-
-  int circle_1_radius = 3 * bone->joint1_mass;
-  int circle_2_radius = 3 * bone->joint2_mass;
-  if (circle_1_radius) {
-    DrawCircleV(joint1_pos, circle_1_radius, RED);
-  } else {
-    DrawCircleV(joint1_pos, 3, BLUE);
-  }
-  if (circle_2_radius) {
-    DrawCircleV(joint2_pos, circle_2_radius, RED);
-  } else {
-    DrawCircleV(joint2_pos, 3, BLUE);
-  }
-}
-
 int main()
 {
   InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Friction Demonstation");
@@ -77,49 +58,34 @@ int main()
 
   rb_init_config(0);
 
-  Vector2 fixed_anchor = {SCREEN_WIDTH / 2.0f, 100};
-
-  RB_Bone bone1 = {
-      .joint1 = 0,
-      .joint2 = 0,
-      .joint1_pos = {50, 300},
-      .joint2_pos = {100, 150},
-      .joint1_mass = 1,
-      .joint2_mass = 1,
-      .joint1_velocity = {0, 0},
-      .joint2_velocity = {0, 0},
-      .length = rb_calculate_distance(&bone1.joint1_pos, &bone1.joint2_pos),
-  };
-
-  RB_Bone bone2 = {
-      .joint1 = 0,
-      .joint2 = 0,
-      .joint1_pos = 0,
-      .joint2_pos = {300, 300},
-      .joint1_mass = 1,
-      .joint2_mass = 1,
-      .joint1_velocity = {0, 0},
-      .joint2_velocity = {0, 0},
-      .length = rb_calculate_distance(&bone2.joint1_pos, &bone2.joint2_pos),
+  // Ground is solid below GROUND_Y, facing up (screen y grows downwards).
+  RB_Collider ground = {
+      .type = RB_COLLIDER_PLANE,
+      .normal = {0, -1},
+      .offset = -GROUND_Y,
   };
+  rb_set_static_colliders(&ground, 1);
+
+  RB_Bone bones[16];
+  size_t bones_count = 0;
+  FILE *scene = fopen("scenes/friction.scene", "r");
+  int loaded = scene && rb_scene_load(scene, bones,
+                                      sizeof(bones) / sizeof(bones[0]),
+                                      &bones_count) == 0;
+  if (scene) {
+    fclose(scene);
+  }
+  if (!loaded) {
+    fprintf(stderr, "Failed to load scenes/friction.scene\n");
+    CloseWindow();
+    return 1;
+  }
 
-  RB_Bone bone3 = {
-      .joint1 = 0,
-      .joint2 = 0,
-      .joint1_pos = 0,
-      .joint2_pos = {400, 200},
-      .joint1_mass = 1,
-      .joint2_mass = 1,
-      .joint1_velocity = {0, 0},
-      .joint2_velocity = {0, 0},
-      .length = rb_calculate_distance(&bone2.joint1_pos, &bone2.joint2_pos),
-  };
-
-  RB_Bone bones[] = {bone1, bone2, bone3};
-  size_t bones_count = sizeof(bones) / sizeof(bones[0]);
-
-  rb_connect_bone(&bones[0], &bones[1]);
-  rb_connect_bone(&bones[1], &bones[2]);
+  BoneRenderer renderer;
+  if (bone_renderer_init(&renderer, bones_count) != 0) {
+    CloseWindow();
+    return 1;
+  }
 
   while (!WindowShouldClose()) {
     float dt = GetFrameTime();
@@ -136,12 +102,11 @@ int main()
 
     DrawRectangle(0, GROUND_Y, SCREEN_WIDTH, SCREEN_HEIGHT - GROUND_Y, BROWN);
 
-    for (size_t i = 0; i < bones_count; ++i) {
-      draw_bone(&bones[i]);
-    }
+    bone_renderer_draw(&renderer, bones, bones_count);
     EndDrawing();
   }
 
+  bone_renderer_free(&renderer);
   CloseWindow();
   return 0;
 }
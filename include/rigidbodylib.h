@@ -1,21 +1,49 @@
 #ifndef REIGIDBODYLIB_H
 #define REIGIDBODYLIB_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+// Deterministic mode (build with DETERMINISTIC=1).
+// Results only depend on inputs, not on platform libm or compiler float
+// contraction, so lockstep peers can compare rb_state_hash values.
+#if defined(RB_DETERMINISTIC) && defined(__FAST_MATH__)
+#error "RB_DETERMINISTIC can't be combined with -ffast-math"
+#endif
+
+// Scalar type used by all bone kernels. Build with DOUBLE=1 (RB_DOUBLE)
+// for double precision. Q16.16 fixed point has its own rb_fx_* kernels.
+#ifdef RB_DOUBLE
+typedef double RB_Scalar;
+#else
+typedef float RB_Scalar;
+#endif
+
 typedef struct {
-    float gravity_scale;
-    float spring_scale;
-    float damping_scale;
+    RB_Scalar gravity_scale;
+    RB_Scalar spring_scale;
+    RB_Scalar damping_scale;
 } RB_Config;
 
 extern RB_Config rb_global_config;
 
 typedef struct {
-  float x;
-  float y;
+  RB_Scalar x;
+  RB_Scalar y;
 } RB_Vector2;
 
+typedef struct {
+  RB_Vector2 min;
+  RB_Vector2 max;
+} RB_AABB;
+
+// Bone flags.
+// RB_BONE_CCD sweeps both joints against static colliders
+// (see rb_set_static_colliders) instead of only checking the end position.
+#define RB_BONE_CCD (1 << 0)
+
 // Base bone structure.
 // The main bone needs to have both joint1 and joint2 positions
 // defined specifically. All other bones, if connected with rb_connect_bone
@@ -30,22 +58,39 @@ typedef struct {
   RB_Vector2 joint2_force;
   RB_Vector2 joint1_velocity;
   RB_Vector2 joint2_velocity;
-  float joint1_mass;
-  float joint2_mass;
-  float length;
+  RB_Scalar joint1_mass;
+  RB_Scalar joint2_mass;
+  RB_Scalar length;
+  int flags;
 } RB_Bone;
 
+typedef enum {
+  RB_COLLIDER_PLANE,
+  RB_COLLIDER_BOX,
+} RB_ColliderType;
+
+// Static collider.
+// Plane: solid on the side opposite to normal, surface is at
+// dot(normal, p) == offset. normal must be unit length.
+// Box: solid axis aligned box.
+typedef struct {
+  RB_ColliderType type;
+  RB_Vector2 normal;
+  RB_Scalar offset;
+  RB_AABB box;
+} RB_Collider;
+
 void rb_init_config(const RB_Config *config);
 
-float rb_calculate_distance(RB_Vector2 *v1, RB_Vector2 *v2);
+RB_Scalar rb_calculate_distance(RB_Vector2 *v1, RB_Vector2 *v2);
 void rb_calculate_object_resistance_force(RB_Bone *bone);
-void rb_calculate_joint_resistance(RB_Bone *bone, float dt);
+void rb_calculate_joint_resistance(RB_Bone *bone, RB_Scalar dt);
 
-void rb_apply_gravity(RB_Bone *bone, float dt);
+void rb_apply_gravity(RB_Bone *bone, RB_Scalar dt);
 
-void rb_apply_force(RB_Bone *bone, float dt);
-void rb_apply_velocity(RB_Bone *bone, float dt);
-void rb_apply_joint_constraint(RB_Bone *parent, RB_Bone *child, float dt);
+void rb_apply_force(RB_Bone *bone, RB_Scalar dt);
+void rb_apply_velocity(RB_Bone *bone, RB_Scalar dt);
+void rb_apply_joint_constraint(RB_Bone *parent, RB_Bone *child, RB_Scalar dt);
 
 // Pre-update bones, calculating constraints for all bones.
 // Needs to be called before rb_update_bones, as it expects
@@ -54,11 +99,859 @@ void rb_pre_update_bones(RB_Bone *bones, size_t bones_count);
 
 // Can be used to update individual bone, applying all forces and constraints.
 // You can as well do that by calling individual functions.
-void rb_update_bone(RB_Bone *bone, float dt);
-void rb_update_bones(RB_Bone *bones, size_t bones_count, float dt);
+void rb_update_bone(RB_Bone *bone, RB_Scalar dt);
+// Steps all bones: rb_pre_update_bones, then rb_update_bone on each bone
+// in order.
+void rb_update_bones(RB_Bone *bones, size_t bones_count, RB_Scalar dt);
+// Same over bones[indices[0..count)]. Joint links must stay within the
+// listed bones. Adds to rb_step_stats instead of resetting them.
+void rb_update_bone_list(RB_Bone *bones, const uint32_t *indices,
+                         size_t count, RB_Scalar dt);
 
 // Always connects parent joint2 to child and child joint1 to parent.
 // joint1_pos of child bone will be always set to joint2_pos of the parent bone.
 void rb_connect_bone(RB_Bone *parent, RB_Bone *child);
 
+// Instant velocity change of joint (1 or 2) by impulse / joint mass.
+// Joints with zero mass are pinned and ignore impulses.
+void rb_apply_impulse(RB_Bone *bone, int joint, RB_Vector2 impulse);
+
+// Registers static colliders used by RB_BONE_CCD bones. The array is not
+// copied and has to outlive the simulation. Pass 0, 0 to clear.
+void rb_set_static_colliders(const RB_Collider *colliders, size_t count);
+
+// Signed distance from p to the collider surface, negative inside.
+// Writes the outward surface normal closest to p.
+RB_Scalar rb_collider_distance(const RB_Collider *collider, RB_Vector2 p,
+                               RB_Vector2 *normal);
+
+// Moves a joint by velocity * dt using conservative advancement against
+// the static colliders. On impact the joint stops at the surface, loses
+// its velocity into the collider and slides for the remaining time.
+// Returns 1 if the joint touched a collider.
+int rb_sweep_joint(RB_Vector2 *pos, RB_Vector2 *velocity, RB_Scalar dt);
+
+// Pair of overlapping objects, stored as indices. For bone-bone pairs
+// both are indices into the bones array (a < b).
+typedef struct {
+  uint32_t a;
+  uint32_t b;
+} RB_Pair;
+
+// Growable pair storage. Keep it around between steps so that
+// reporting pairs does not allocate once the capacity settles.
+typedef struct {
+  RB_Pair *pairs;
+  size_t count;
+  size_t capacity;
+} RB_PairBuffer;
+
+typedef struct {
+  RB_AABB aabb;
+  uint32_t index;
+} RB_SapEntry;
+
+// Sweep-and-prune broadphase along the x axis.
+// Entries stay sorted by aabb.min.x between updates, so for coherent
+// scenes re-sorting with insertion sort is close to linear.
+typedef struct {
+  RB_SapEntry *entries;
+  size_t count;
+  size_t capacity;
+} RB_SweepAndPrune;
+
+RB_AABB rb_bone_aabb(const RB_Bone *bone);
+int rb_aabb_overlap(const RB_AABB *a, const RB_AABB *b);
+
+// Appends a pair, growing the buffer. Returns 0 on allocation failure.
+int rb_pair_buffer_push(RB_PairBuffer *buffer, uint32_t a, uint32_t b);
+void rb_pair_buffer_free(RB_PairBuffer *buffer);
+
+void rb_sap_init(RB_SweepAndPrune *sap);
+void rb_sap_free(RB_SweepAndPrune *sap);
+
+// Refreshes bone AABBs, re-sorts and writes all overlapping pairs into
+// pairs (previous content is discarded). Bones linked with
+// rb_connect_bone always touch, so such pairs are not reported.
+// Returns the number of pairs.
+size_t rb_sap_update(RB_SweepAndPrune *sap, const RB_Bone *bones,
+                     size_t bones_count, RB_PairBuffer *pairs);
+
+#define RB_NULL_NODE (-1)
+
+// What a leaf's user_index refers to. rb_aabb_tree_insert adds static
+// proxies, rb_aabb_tree_update_bones bone proxies.
+typedef enum {
+  RB_PROXY_STATIC,
+  RB_PROXY_BONE,
+} RB_ProxyKind;
+
+typedef struct {
+  RB_AABB aabb;
+  int parent; // next free node while the node is on the free list
+  int child1;
+  int child2;
+  int height; // 0 for leaves, -1 for free nodes
+  int user_index;
+  RB_ProxyKind kind;
+} RB_AABBTreeNode;
+
+// Dynamic bounding volume tree.
+// Leaves store AABBs fattened by margin, so a proxy only gets
+// re-inserted once its tight box leaves the fat one. Static colliders
+// are inserted once and never touched again.
+typedef struct {
+  RB_AABBTreeNode *nodes;
+  int root;
+  int node_count;
+  int node_capacity;
+  int free_list;
+  RB_Scalar margin;
+} RB_AABBTree;
+
+// Called for every leaf overlapping the query box.
+// Return 0 to stop the query early.
+typedef int (*RB_TreeQueryFn)(int user_index, void *user);
+
+void rb_aabb_tree_init(RB_AABBTree *tree, RB_Scalar margin);
+void rb_aabb_tree_free(RB_AABBTree *tree);
+
+// Returns proxy id, or RB_NULL_NODE on allocation failure.
+int rb_aabb_tree_insert(RB_AABBTree *tree, const RB_AABB *aabb,
+                        int user_index);
+void rb_aabb_tree_remove(RB_AABBTree *tree, int proxy);
+
+// Moves a proxy, displacement extends the fat box in the direction of
+// motion. Returns 1 if the proxy had to be re-inserted.
+int rb_aabb_tree_move(RB_AABBTree *tree, int proxy, const RB_AABB *aabb,
+                      RB_Vector2 displacement);
+
+// Inserts bones on first call (proxies[i] == RB_NULL_NODE), otherwise
+// moves them. proxies must have bones_count entries. Bone index is
+// used as user_index.
+void rb_aabb_tree_update_bones(RB_AABBTree *tree, const RB_Bone *bones,
+                               size_t bones_count, int *proxies, RB_Scalar dt);
+
+// Returns 0, or -1 if growing the traversal stack failed and part of the
+// tree was skipped.
+int rb_aabb_tree_query(const RB_AABBTree *tree, const RB_AABB *aabb,
+                       RB_TreeQueryFn fn, void *user);
+
+// Bone-vs-world query. Reports (bone index, user_index) pairs of every
+// bone overlapping a leaf added with rb_aabb_tree_insert into pairs. Bone
+// proxies are skipped, bone-bone pairs come from the broadphase.
+// Returns 0, or -1 if the pair buffer or the traversal stack could not
+// grow and pairs is incomplete.
+int rb_aabb_tree_query_bones(const RB_AABBTree *tree, const RB_Bone *bones,
+                             size_t bones_count, RB_PairBuffer *pairs);
+
+#define RB_NO_HIT UINT32_MAX
+
+typedef struct {
+  RB_Vector2 origin;
+  RB_Vector2 direction;
+  RB_Scalar max_t;
+} RB_Ray;
+
+typedef struct {
+  uint32_t bone; // index into the bones array, RB_NO_HIT on miss
+  RB_Scalar t;       // hit point is origin + t * direction
+  RB_Vector2 point;
+  RB_Vector2 normal; // faces against the ray
+} RB_RayHit;
+
+// Bones are treated as segments between joint1_pos and joint2_pos.
+// tree is optional: pass one built with rb_aabb_tree_update_bones
+// (user indices are bone indices) to skip distant bones, or 0 to test
+// every bone. Static proxies in the tree are skipped. Return 1 and fill
+// hit with the nearest bone on hit.
+int rb_raycast(const RB_Bone *bones, size_t bones_count,
+               const RB_AABBTree *tree, RB_Vector2 origin,
+               RB_Vector2 direction, RB_Scalar max_t, RB_RayHit *hit);
+// Same as rb_raycast from p1 to p2, hit->t is in [0, 1].
+int rb_segment_cast(const RB_Bone *bones, size_t bones_count,
+                    const RB_AABBTree *tree, RB_Vector2 p1, RB_Vector2 p2,
+                    RB_RayHit *hit);
+
+// Casts many rays at once. Rays are processed in packets that traverse
+// the tree together and are intersected lane-wise, so the inner loops
+// vectorize over rays. hits must have ray_count entries.
+// Returns the number of rays that hit something.
+size_t rb_raycast_batch(const RB_Bone *bones, size_t bones_count,
+                        const RB_AABBTree *tree, const RB_Ray *rays,
+                        size_t ray_count, RB_RayHit *hits);
+
+#define RB_SNAPSHOT_MAGIC 0x53425252 // "RRBS"
+#define RB_SNAPSHOT_VERSION 1
+
+// Everything in RB_Bone after the two link pointers. Snapshots copy this
+// block as is, so new bone fields have to stay after joint1_pos.
+#define RB_BONE_STATE_OFFSET offsetof(RB_Bone, joint1_pos)
+#define RB_BONE_STATE_SIZE (sizeof(RB_Bone) - RB_BONE_STATE_OFFSET)
+
+// Snapshot layout: header followed by bones_count records, each holding
+// the bone links as indices (-1 for none) and then the raw bone state.
+// Static colliders are not part of the snapshot.
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t bones_count;
+  RB_Config config;
+} RB_SnapshotHeader;
+
+typedef struct {
+  int32_t joint1;
+  int32_t joint2;
+} RB_SnapshotLinks;
+
+size_t rb_snapshot_size(size_t bones_count);
+
+// Writes bones and rb_global_config into buffer. Bone links have to point
+// into the same bones array. Returns bytes written, 0 if buffer is too small
+// or a link points outside the array.
+size_t rb_snapshot_save(const RB_Bone *bones, size_t bones_count,
+                        void *buffer, size_t buffer_size);
+
+// Restores up to capacity bones and rb_global_config from a snapshot.
+// Returns 0 on success, -1 if the snapshot is malformed, from another
+// version or does not fit; bones and the config are then left untouched.
+int rb_snapshot_load(const void *buffer, size_t buffer_size, RB_Bone *bones,
+                     size_t capacity, size_t *bones_count);
+
+#define RB_MAPPED_SNAPSHOT_MAGIC 0x4d425252 // "RRBM"
+#define RB_MAPPED_SNAPSHOT_VERSION 1
+
+// Mappable snapshot layout.
+// The file holds the RB_Bone array exactly as the solver uses it, starting
+// at bones_offset (aligned for RB_Bone). Links are stored as pointers valid
+// for a mapping at base_address. If the file maps there, loading is free,
+// otherwise links are relocated once by the mapping difference.
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t bone_size;
+  uint32_t pointer_size;
+  uint64_t bones_count;
+  uint64_t bones_offset;
+  uint64_t base_address;
+  uint64_t payload_checksum;
+  RB_Config config;
+  uint32_t header_checksum; // over all fields above
+} RB_MappedSnapshotHeader;
+
+typedef struct {
+  RB_Bone *bones;
+  size_t bones_count;
+  void *mapping;
+  size_t mapping_size;
+  int relocated; // 1 if links had to be patched while opening
+} RB_MappedSnapshot;
+
+// Writes bones and rb_global_config into a mappable snapshot file.
+// Returns 0 on success, -1 on I/O error or links outside the array.
+int rb_mapped_snapshot_save(const char *path, const RB_Bone *bones,
+                            size_t bones_count);
+
+// Maps a snapshot copy-on-write and restores rb_global_config. The
+// bones can be simulated in place; changes are not written back.
+// Only the header is validated. Links are range checked when they have
+// to be relocated; at the saved address they are used as stored, so run
+// rb_mapped_snapshot_verify on files that may be damaged or untrusted.
+// Returns 0 on success, -1 on failure.
+int rb_mapped_snapshot_open(const char *path, RB_MappedSnapshot *snapshot);
+void rb_mapped_snapshot_close(RB_MappedSnapshot *snapshot);
+
+// Checks that every link points into the bones array and the bone
+// payload against the checksum stored on save. Touches every page, so
+// only do it when it matters (crash recovery, untrusted files). Must run
+// before the bones are stepped. Returns 0 if intact.
+int rb_mapped_snapshot_verify(const RB_MappedSnapshot *snapshot);
+
+// Bones per hash block. Blocks can be hashed independently (e.g. on
+// different threads) and combined in block order, giving the same value
+// as rb_state_hash no matter how the work was split.
+#define RB_STATE_HASH_BLOCK 1024
+
+// Hash of joint positions and velocities, by bit
+// pattern (-0 and 0 hash the same, as do all NaNs).
+uint64_t rb_state_hash(const RB_Bone *bones, size_t bones_count);
+uint64_t rb_state_hash_block(const RB_Bone *bones, size_t bones_count,
+                             size_t block);
+uint64_t rb_state_hash_combine(const uint64_t *block_hashes, size_t blocks);
+
+// Q16.16 fixed point backend.
+// Same model as the RB_Bone kernels in integer math, so results are bit
+// exact on every platform regardless of compiler and FPU. The only
+// floating point step seeds the integer square root, which then corrects
+// the seed to the exact root.
+// Positions and velocities have to stay within +-32768 units, wider
+// intermediates use 64-bit integers and forces saturate.
+// Static colliders are not supported here.
+typedef int32_t RB_Fixed;
+
+#define RB_FX_SHIFT 16
+#define RB_FX_ONE (1 << RB_FX_SHIFT)
+
+typedef struct {
+  RB_Fixed x;
+  RB_Fixed y;
+} RB_FxVector2;
+
+typedef struct {
+  void *joint1;
+  void *joint2;
+  RB_FxVector2 joint1_pos;
+  RB_FxVector2 joint2_pos;
+  RB_FxVector2 joint1_force;
+  RB_FxVector2 joint2_force;
+  RB_FxVector2 joint1_velocity;
+  RB_FxVector2 joint2_velocity;
+  RB_Fixed joint1_mass;
+  RB_Fixed joint2_mass;
+  RB_Fixed length;
+} RB_FxBone;
+
+// Saturates out of range values, NaN converts to 0.
+RB_Fixed rb_fx_from_scalar(RB_Scalar v);
+RB_Scalar rb_fx_to_scalar(RB_Fixed v);
+RB_Fixed rb_fx_mul(RB_Fixed a, RB_Fixed b);
+RB_Fixed rb_fx_div(RB_Fixed a, RB_Fixed b);
+RB_Fixed rb_fx_sqrt(RB_Fixed v);
+// Returns v scaled to unit length, or (1, 0) for a zero vector.
+RB_FxVector2 rb_fx_normalize(RB_FxVector2 v);
+
+// Converts between float and fixed bones. Links are remapped to the
+// same index in the output array. rb_fx_from_bones returns 0, or -1
+// without writing out if a link points outside the array.
+int rb_fx_from_bones(const RB_Bone *bones, size_t bones_count,
+                     RB_FxBone *out);
+void rb_fx_to_bones(const RB_FxBone *bones, size_t bones_count, RB_Bone *out);
+
+// Fixed point rb_update_bones. Uses rb_global_config converted to Q16.16.
+void rb_fx_update_bones(RB_FxBone *bones, size_t bones_count, RB_Fixed dt);
+
+#define RB_REPLAY_MAGIC 0x4c425252 // "RRBL"
+#define RB_REPLAY_VERSION 1
+
+// Replay flags.
+// RB_REPLAY_HASHES stores rb_state_hash after every step so a replay can
+// report the first frame where it diverged.
+#define RB_REPLAY_HASHES (1 << 0)
+
+// Records a session as a stream: header, initial snapshot, then one
+// record per impulse and per step. Repeated dt values cost one byte.
+// Only impulses and steps made through the recorder are captured.
+typedef struct {
+  FILE *file;
+  int flags;
+  RB_Scalar last_dt;
+  uint64_t frames;
+} RB_Recorder;
+
+typedef struct {
+  uint64_t frames;
+  uint64_t first_divergent_frame; // UINT64_MAX if hashes matched or absent
+} RB_ReplayResult;
+
+// Writes the header and initial snapshot. Returns 0 on success.
+int rb_recorder_begin(RB_Recorder *recorder, FILE *file, const RB_Bone *bones,
+                      size_t bones_count, int flags);
+// rb_apply_impulse on bones[bone], logged for replay.
+void rb_recorder_apply_impulse(RB_Recorder *recorder, RB_Bone *bones,
+                               uint32_t bone, int joint, RB_Vector2 impulse);
+// rb_update_bones, logged for replay.
+void rb_recorder_step(RB_Recorder *recorder, RB_Bone *bones,
+                      size_t bones_count, RB_Scalar dt);
+// Flushes the stream. The file stays open. Returns 0 on success.
+int rb_recorder_end(RB_Recorder *recorder);
+
+// Re-simulates a recording as fast as possible into bones (up to
+// capacity). Stops after stop_frame steps (UINT64_MAX for all), which
+// together with first_divergent_frame allows bisecting a divergence.
+// Returns 0 on success, -1 on a malformed or incompatible stream.
+int rb_replay_run(FILE *file, RB_Bone *bones, size_t capacity,
+                  size_t *bones_count, uint64_t stop_frame,
+                  RB_ReplayResult *result);
+
+// Frames kept by the stream encoder and decoder. A frame can be delta
+// encoded against any of the last RB_STREAM_HISTORY frames.
+#define RB_STREAM_HISTORY 32
+#define RB_STREAM_KEYFRAME UINT32_MAX
+
+// Delta compressed joint positions for remote viewers.
+// Positions are quantized to multiples of quantum (saturating, NaN is sent
+// as 0), delta encoded against the last frame the receiver acknowledged
+// (or sent as a keyframe when there is none) and bit packed in blocks of
+// 16 values.
+typedef struct {
+  RB_Scalar quantum;
+  size_t bones_count;
+  int32_t *frames; // RB_STREAM_HISTORY slots of 4 coordinates per bone
+  uint32_t frame_ids[RB_STREAM_HISTORY];
+  uint32_t acked_frame;
+} RB_StreamEncoder;
+
+typedef struct {
+  RB_Scalar quantum;
+  size_t bones_count;
+  int32_t *frames;
+  uint32_t frame_ids[RB_STREAM_HISTORY];
+} RB_StreamDecoder;
+
+// Returns 0 on success, -1 on allocation failure.
+int rb_stream_encoder_init(RB_StreamEncoder *encoder, size_t bones_count,
+                           RB_Scalar quantum);
+void rb_stream_encoder_free(RB_StreamEncoder *encoder);
+// Receiver has frame; later frames are encoded against it. Pipes without a
+// back channel can ack every frame right after encoding it.
+void rb_stream_encoder_ack(RB_StreamEncoder *encoder, uint32_t frame);
+
+// Upper bound of the encoded size of one frame.
+size_t rb_stream_encode_bound(size_t bones_count);
+// Encodes joint positions of bones as frame. frame must not be
+// RB_STREAM_KEYFRAME. Returns bytes written, 0 if out is too small.
+size_t rb_stream_encode(RB_StreamEncoder *encoder, uint32_t frame,
+                        const RB_Bone *bones, void *out, size_t out_size);
+
+int rb_stream_decoder_init(RB_StreamDecoder *decoder, size_t bones_count,
+                           RB_Scalar quantum);
+void rb_stream_decoder_free(RB_StreamDecoder *decoder);
+// Decodes a frame into positions (joint1, joint2 per bone). Returns 0 on
+// success, -1 if the data is malformed or its baseline frame is unknown.
+// A malformed frame also drops whichever frame shared its history slot.
+int rb_stream_decode(RB_StreamDecoder *decoder, const void *data, size_t size,
+                     uint32_t *frame, RB_Vector2 *positions);
+
+// Step statistics, filled by rb_update_bones when the library is built
+// with STATS=1 (RB_ENABLE_STATS) and left zero otherwise. Timings are
+// wall clock seconds spent in each phase over all bones of the last step
+// on this thread. Every call is timed, which slows the step down.
+typedef enum {
+  RB_PHASE_FORCES,    // resistance forces
+  RB_PHASE_JOINTS,    // joint constraints
+  RB_PHASE_GRAVITY,
+  RB_PHASE_INTEGRATE, // velocities, and positions of bones without CCD
+  RB_PHASE_COLLISION, // swept positions of RB_BONE_CCD bones
+  RB_PHASE_COUNT,
+} RB_Phase;
+
+typedef struct {
+  double phase_seconds[RB_PHASE_COUNT];
+  uint64_t constraints_solved;
+  // Largest gap between parent joint2 and child joint1 a joint constraint
+  // started from.
+  RB_Scalar max_constraint_error;
+} RB_StepStats;
+
+extern _Thread_local RB_StepStats rb_step_stats;
+
+// World: a bones array stepped as a whole, with a frame counter.
+// The world does not own bones. rollback is optional, when set every
+// rb_world_step records the step into it before stepping.
+typedef struct RB_Rollback RB_Rollback;
+typedef struct RB_DiagnosticsMonitor RB_DiagnosticsMonitor;
+typedef struct RB_Islands RB_Islands;
+typedef struct RB_CommandQueue RB_CommandQueue;
+
+typedef struct {
+  RB_Bone *bones;
+  size_t bones_count;
+  size_t bones_capacity; // room in bones for spawned bones, >= bones_count
+  uint64_t frame;
+  RB_Rollback *rollback;
+  RB_DiagnosticsMonitor *diagnostics; // optional, checked after each step
+  RB_Islands *islands; // optional, steps with rb_update_islands when set
+  RB_CommandQueue *commands; // optional, drained at the start of each step
+  RB_StepStats stats; // rb_step_stats of the last rb_world_step
+} RB_World;
+
+void rb_world_init(RB_World *world, RB_Bone *bones, size_t bones_count);
+void rb_world_step(RB_World *world, RB_Scalar dt);
+
+// Per bone state that changes while stepping. Links, masses, lengths and
+// flags are shared with the world and not captured. Forces are recomputed
+// at the start of every step.
+typedef struct {
+  RB_Vector2 joint1_pos;
+  RB_Vector2 joint2_pos;
+  RB_Vector2 joint1_velocity;
+  RB_Vector2 joint2_velocity;
+} RB_BoneState;
+
+void rb_bone_states_save(const RB_Bone *bones, size_t bones_count,
+                         RB_BoneState *states);
+void rb_bone_states_restore(RB_Bone *bones, size_t bones_count,
+                            const RB_BoneState *states);
+
+// Rollback buffer for rollback netcode.
+// The dt of every step is recorded, the bone state only every interval
+// frames. Rewinding restores the closest capture and steps forward to the
+// requested frame, so a larger interval makes recording cheaper and
+// rewinding up to interval - 1 steps more expensive.
+struct RB_Rollback {
+  RB_BoneState *states; // capacity captures of max_bones states
+  size_t *counts;       // bones_count of each capture
+  RB_Scalar *dts;       // capacity * interval steps
+  size_t capacity;
+  size_t max_bones;
+  uint32_t interval;
+  uint64_t first_frame; // oldest capture, empty when equal to end_frame
+  uint64_t end_frame;   // one past the newest recorded step
+};
+
+// Returns 0 on success, -1 on allocation failure.
+int rb_rollback_init(RB_Rollback *rollback, size_t capacity,
+                     size_t max_bones, uint32_t interval);
+void rb_rollback_free(RB_Rollback *rollback);
+
+// Called by rb_world_step before stepping. Recording a frame before
+// end_frame drops the frames after it. Worlds with more than max_bones
+// bones empty the buffer instead.
+void rb_rollback_record(RB_Rollback *rollback, const RB_World *world,
+                        RB_Scalar dt);
+
+// Called before every step a rewind or resimulation takes, with the frame
+// about to be stepped in world->frame, so inputs can be applied again.
+typedef void (*RB_ResimulateFn)(RB_World *world, void *user);
+
+// Moves the world back frames steps. Returns 0 on success, -1 if that
+// frame is no longer in the buffer. Recorded frames after it stay valid
+// until the world steps again. Bones spawned after that frame are
+// dropped, links to them cleared and world->islands rebuilt; other link
+// changes are not undone.
+int rb_world_rewind(RB_World *world, uint64_t frames, RB_ResimulateFn fn,
+                    void *user);
+
+// Rewinds frames steps and steps back to the current frame with the
+// recorded dts. These steps neither drain world->commands nor run
+// world->diagnostics. Returns 0 on success, -1 if the rewind failed.
+int rb_world_resimulate(RB_World *world, uint64_t frames,
+                        RB_ResimulateFn fn, void *user);
+
+// Text scenes, one statement per line, '#' starts a comment:
+//
+//   config gravity 200 spring 600 damping 50
+//   bone joint1 400 100 joint2 400 190 mass 0 1
+//   bone joint2 400 280 parent -1 velocity2 300 0
+//
+// bone keys: joint1 x y, joint2 x y, mass m1 m2 (default 1 1),
+// velocity1 x y, velocity2 x y, parent i, length l, ccd.
+// parent is the index of an earlier bone, negative values count back from
+// the current one (-1 is the previous bone). The bone is connected with
+// rb_connect_bone, which takes joint1 and length from the parent; an
+// explicit length is applied afterwards. Without parent the length is the
+// distance between the joints.
+// config keys are gravity, spring and damping.
+
+// Reads a scene from file into bones and applies its config lines to
+// rb_global_config. Returns 0 on success, -1 on a read error, otherwise the
+// number of the first line that is malformed or does not fit into capacity.
+// The config is only applied when the whole scene loaded. Numbers must be
+// finite.
+int rb_scene_load(FILE *file, RB_Bone *bones, size_t capacity,
+                  size_t *bones_count);
+
+// Timeline tracing, built in with TRACE=1 (RB_ENABLE_TRACE). Stepping
+// records a complete event per phase and per world step into a ring buffer
+// owned by the calling thread; the newest RB_TRACE_CAPACITY events of
+// every thread are kept until the thread exits. Phases interleave bone
+// by bone, so phase events show each phase's total, back to back from the
+// start of the step. Without the flag nothing is recorded and dumps are
+// empty.
+#define RB_TRACE_CAPACITY 65536
+
+// Records an event on the calling thread. Times are rb_trace_now seconds.
+// name and arg_name (0 for no argument) must stay valid until the dump,
+// string literals are the intended use.
+void rb_trace_event(const char *name, const char *arg_name, int64_t arg,
+                    double start, double end);
+double rb_trace_now(void);
+
+// Writes all recorded events as Chrome trace JSON, which chrome://tracing
+// and ui.perfetto.dev open. Call it while no thread is recording.
+// Returns 0 on success, -1 on a write error.
+int rb_trace_dump(FILE *file);
+// Drops all recorded events. Same restriction as rb_trace_dump.
+void rb_trace_reset(void);
+
+// Health of a set of bones. Length errors compare the joint distance with
+// RB_Bone.length, joint separation is the gap between a parent's joint2
+// and its child's joint1. Potential energy is gravitational (y grows
+// downwards, zero at y == 0) plus the spring energy of the length errors.
+// Pinned joints (mass 0) carry no energy.
+typedef struct {
+  RB_Scalar max_length_error;
+  RB_Scalar mean_length_error;
+  RB_Scalar max_joint_separation;
+  RB_Scalar kinetic_energy;
+  RB_Scalar potential_energy;
+} RB_Diagnostics;
+
+void rb_compute_diagnostics(const RB_Bone *bones, size_t bones_count,
+                            RB_Diagnostics *diagnostics);
+
+typedef void (*RB_DiagnosticsFn)(RB_World *world,
+                                 const RB_Diagnostics *diagnostics,
+                                 void *user);
+
+// Attached to RB_World.diagnostics, rb_world_step computes diagnostics
+// after stepping and calls fn when any threshold is exceeded or the
+// kinetic energy is NaN. A threshold of 0 is ignored. The callback may
+// change the world, e.g. rewind it or reset the bones.
+struct RB_DiagnosticsMonitor {
+  RB_Scalar max_length_error;
+  RB_Scalar max_joint_separation;
+  RB_Scalar max_kinetic_energy;
+  RB_DiagnosticsFn fn;
+  void *user;
+  RB_Diagnostics last; // of the last step
+};
+
+// Adaptive substepping of a whole bones array, e.g. a world's bones.
+// rb_update_bones_adaptive advances bones by dt in substeps of about
+// adaptive->dt, which it grows or shrinks between min_dt and max_dt.
+// The local error of a substep is how much it increased the worst
+// constraint violation, the larger of max_length_error and
+// max_joint_separation (see RB_Diagnostics). A substep with an error above
+// tolerance is undone and retried smaller, unless it is min_dt already or
+// RB_ADAPTIVE_MAX_REJECTED substeps were rejected in this call.
+#define RB_ADAPTIVE_MAX_REJECTED 64
+
+typedef struct {
+  RB_Scalar min_dt;
+  RB_Scalar max_dt;
+  RB_Scalar tolerance;
+  RB_Scalar dt;         // size of the next substep
+  RB_BoneState *states; // undo buffer for capacity bones
+  size_t capacity;
+  uint32_t substeps;    // accepted substeps of the last call
+  uint32_t rejected;    // rejected substeps of the last call
+} RB_AdaptiveStep;
+
+// Starts at max_dt. Returns 0 on success, -1 on allocation failure or
+// unless 0 < min_dt <= max_dt.
+int rb_adaptive_step_init(RB_AdaptiveStep *adaptive, size_t capacity,
+                          RB_Scalar min_dt, RB_Scalar max_dt,
+                          RB_Scalar tolerance);
+void rb_adaptive_step_free(RB_AdaptiveStep *adaptive);
+
+// Returns 0 on success, -1 without stepping if bones_count exceeds the
+// capacity of the undo buffer or dt is infinite or NaN.
+int rb_update_bones_adaptive(RB_AdaptiveStep *adaptive, RB_Bone *bones,
+                             size_t bones_count, RB_Scalar dt);
+
+// Islands: groups of bones connected through joint links, stepped at
+// their own rate. rb_update_islands gives every island a power of two
+// substep count, the smallest one keeping both
+//   substep * sqrt(spring_scale / joint mass) <= max_stiffness
+//   substep * joint speed <= max_travel * bone length
+// for all of its bones, up to max_substeps rounded up to a power of two.
+// Islands with the same count
+// are stepped together as one batch, so a few fast ragdolls take small
+// substeps while resting ones take the whole dt at once.
+#define RB_ISLAND_LEVELS 16 // substep counts 1, 2, 4, ... 1 << 15
+
+struct RB_Islands {
+  size_t capacity;
+  size_t bones_count;
+  size_t count;          // islands
+  uint32_t *island;      // island of each bone
+  uint32_t *first;       // count + 1 offsets into bones
+  uint32_t *bones;       // bone indices grouped by island, in bone order
+  uint8_t *level;        // log2 of the substep count of each island
+  uint32_t *batch_bones; // bone indices grouped by level
+  uint32_t batch_first[RB_ISLAND_LEVELS + 1];
+  uint32_t *batch_islands;      // island ids in batch_bones order
+  uint32_t *batch_island_first; // count + 1 offsets into batch_bones
+  uint32_t max_substeps;
+  RB_Scalar max_stiffness;
+  RB_Scalar max_travel;
+};
+
+// Defaults: max_substeps 16, max_stiffness 0.5, max_travel 0.25.
+// Returns 0 on success, -1 on allocation failure.
+int rb_islands_init(RB_Islands *islands, size_t capacity);
+void rb_islands_free(RB_Islands *islands);
+
+// Finds the islands of bones. Call again after linking or unlinking
+// bones. Returns -1 if bones_count exceeds the capacity.
+int rb_islands_build(RB_Islands *islands, const RB_Bone *bones,
+                     size_t bones_count);
+
+// Picks the substep count of every island for a step of dt and groups
+// the bones into batch_bones, batch_first[level] being where the bones
+// stepped 1 << level times start.
+void rb_plan_islands(RB_Islands *islands, const RB_Bone *bones, RB_Scalar dt);
+
+// Plans, then steps every batch. Bones must be the array the islands were
+// built from. With a job system set (rb_set_job_system) the batches are
+// cut into bone ranges that run in parallel, each range stepping the
+// islands starting in it.
+void rb_update_islands(RB_Islands *islands, RB_Bone *bones, RB_Scalar dt);
+
+// Steps many small worlds at once. Runs of up to RB_WORLD_LANES worlds in
+// a row whose bones are linked the same way are interleaved one world per
+// SIMD lane and stepped in lockstep. Worlds with more than
+// RB_WORLD_LANES_MAX_BONES bones, RB_BONE_CCD bones, rollback,
+// diagnostics or islands are stepped one by one with rb_world_step.
+// Lockstep worlds get the RB_DETERMINISTIC angle computation, so they
+// match rb_update_bones exactly in deterministic builds and up to rounding
+// otherwise. Their stats are left zero.
+#define RB_WORLD_LANES 8
+#define RB_WORLD_LANES_MAX_BONES 16
+
+void rb_step_worlds(RB_World *worlds, size_t count, RB_Scalar dt);
+
+// Parallel stepping. rb_update_islands and rb_step_worlds hand out their
+// independent work (islands, runs of worlds) as index ranges through the
+// job system set with rb_set_job_system. Results do not depend on how
+// the ranges are split or which threads run them. Step stats only cover
+// the work done on the calling thread.
+typedef void (*RB_TaskFn)(void *data, uint32_t begin, uint32_t end);
+
+// Callbacks into whatever runs the tasks, so the library can run on an
+// engine's own workers instead of starting threads of its own.
+// Every enqueue is followed by a wait from the same thread, and tasks may
+// enqueue and wait again from inside (nested).
+typedef struct {
+  void *context;
+  // Queues fn over [begin, end). Pieces of at least grain items may run
+  // separately on any thread; fn must see every index exactly once.
+  void (*enqueue)(void *context, RB_TaskFn fn, void *data, uint32_t begin,
+                  uint32_t end, uint32_t grain);
+  // Returns once everything this thread enqueued since its last wait has
+  // run. May run tasks itself meanwhile.
+  void (*wait)(void *context);
+} RB_JobSystem;
+
+// Runs every task right away on the calling thread; wait does nothing.
+// The default job system.
+RB_JobSystem rb_serial_job_system(void);
+
+// The struct is copied. Null goes back to rb_serial_job_system.
+void rb_set_job_system(const RB_JobSystem *jobs);
+RB_JobSystem rb_get_job_system(void);
+// Enqueues fn over [0, count) and waits for it.
+void rb_parallel_for(RB_TaskFn fn, void *data, uint32_t count,
+                     uint32_t grain);
+
+// Built-in work-stealing scheduler: threads - 1 worker threads (0 picks
+// one per CPU) plus whichever thread waits. Ranges are split
+// in halves down to their grain and idle threads steal the biggest ones
+// left, so uneven work such as islands of 2 and 2000 bones balances out.
+// Up to 8 threads outside the pool (e.g. a render thread and an
+// rb_async_step thread) can enqueue at once, each on a deque of its own;
+// tasks of any further ones run right away on their own thread.
+// Engines with their own thread pool can pass that in instead.
+typedef struct RB_Scheduler RB_Scheduler;
+
+RB_Scheduler *rb_scheduler_create(int threads);
+void rb_scheduler_destroy(RB_Scheduler *scheduler);
+RB_JobSystem rb_scheduler_job_system(RB_Scheduler *scheduler);
+
+// Asynchronous stepping, so a renderer can draw frame N while the solver
+// computes N + 1. rb_async_step hands one rb_world_step to a thread owned
+// by the RB_AsyncStep and returns. The step does not join the caller's
+// job group, so parallel_for on the calling thread does not wait for it;
+// parallel parts of the step still run on the job system. When a step is
+// done its joint positions (joint1, joint2 per bone) are published.
+//
+// Positions are triple buffered: the stepping task owns a back buffer,
+// the reader owns a front buffer and the third holds the latest frame.
+// With two buffers the task could only publish after the reader let go
+// of the front one, so one side would have to wait or lock.
+//
+// One thread calls rb_async_step and rb_async_step_wait, and leaves the
+// world alone in between. One reader thread, which can be the same one,
+// calls rb_async_positions.
+typedef struct RB_AsyncStep RB_AsyncStep;
+
+// The world's bones_count is fixed from here on: bones_capacity is
+// lowered to bones_count until rb_async_step_destroy, so queued spawns
+// are dropped. Publishes the current state as the first frame and starts
+// the stepping thread. Returns null on allocation failure or if the
+// thread cannot be started.
+RB_AsyncStep *rb_async_step_create(RB_World *world);
+// Waits for a running step first.
+void rb_async_step_destroy(RB_AsyncStep *async);
+
+// Waits for the previous step, then starts the next.
+void rb_async_step(RB_AsyncStep *async, RB_Scalar dt);
+void rb_async_step_wait(RB_AsyncStep *async);
+
+// Latest published positions and their world frame. The array stays
+// unchanged until the next call.
+const RB_Vector2 *rb_async_positions(RB_AsyncStep *async, uint64_t *frame);
+
+// Render extraction: joint positions and masses of all bones in one
+// pass, as floats whatever RB_Scalar is, ready to upload as a vertex
+// buffer. Bone i writes vertices 2i (joint1) and 2i + 1 (joint2), so the
+// buffer draws as a line list and the same vertices mark the joints.
+// Mass 0 marks a pinned joint.
+typedef struct {
+  float x;
+  float y;
+  float mass;
+} RB_RenderVertex;
+
+// out holds 2 * bones_count vertices. Large scenes are split over the job
+// system. To extract off the calling thread, for example right after
+// rb_async_step_wait, call it from a task of your own.
+void rb_extract_vertices(const RB_Bone *bones, size_t bones_count,
+                         RB_RenderVertex *out);
+
+// Command queue for edits from other threads while the world steps.
+// Any number of threads push commands; the stepping thread drains them at
+// the start of rb_world_step (and rb_step_worlds) and applies them in the
+// order their pushes claimed a slot, so two runs that push the same
+// commands in the same order between steps end up identical. Pushing
+// never blocks or allocates: a full queue returns -1 and the caller
+// decides whether to retry or drop the command.
+//
+// Rollback does not record commands, rewinds and resimulations have to
+// apply them again through the RB_ResimulateFn like any other input.
+typedef enum {
+  RB_COMMAND_IMPULSE,    // rb_apply_impulse(bones[bone], joint, impulse)
+  RB_COMMAND_SPAWN,      // appends spawn, connected to bones[other]
+  RB_COMMAND_CONNECT,    // rb_connect_bone(bones[other], bones[bone])
+  RB_COMMAND_DISCONNECT, // unlinks bones[bone] from its parent
+} RB_CommandType;
+
+typedef struct {
+  RB_CommandType type;
+  uint32_t bone;
+  uint32_t other; // parent bone, UINT32_MAX for none
+  int joint;
+  RB_Vector2 impulse;
+  RB_Bone spawn; // links are ignored
+} RB_Command;
+
+// capacity is rounded up to a power of two. Returns null on allocation
+// failure.
+RB_CommandQueue *rb_command_queue_create(size_t capacity);
+void rb_command_queue_destroy(RB_CommandQueue *queue);
+
+// Thread safe. Return 0, or -1 when the queue is full.
+int rb_command_push(RB_CommandQueue *queue, const RB_Command *command);
+int rb_command_impulse(RB_CommandQueue *queue, uint32_t bone, int joint,
+                       RB_Vector2 impulse);
+// Spawned bones take the next index. A parent connects the bone with
+// rb_connect_bone, otherwise a zero length is measured from the joints.
+// A parent's previous child, if any, is left without a parent.
+int rb_command_spawn(RB_CommandQueue *queue, const RB_Bone *bone,
+                     uint32_t parent);
+// Disconnects child from its current parent first. Like spawns, leaves
+// the parent's previous child without a parent.
+int rb_command_connect(RB_CommandQueue *queue, uint32_t parent,
+                       uint32_t child);
+int rb_command_disconnect(RB_CommandQueue *queue, uint32_t bone);
+
+// Applies the published commands to world, from one thread at a time.
+// Commands with bone indices out of range, and spawns beyond
+// bones_capacity, are dropped. Islands are rebuilt when links changed, so
+// their capacity has to cover bones_capacity. Returns the number of
+// commands taken from the queue.
+size_t rb_command_queue_drain(RB_CommandQueue *queue, RB_World *world);
+
 #endif // RIGIDBODYLIB_H
@@ -0,0 +1,445 @@
+#include "rigidbodylib.h"
+#include "rb_math.h"
+#include <string.h>
+
+#define TREE_STACK_SIZE 256
+#define DISPLACEMENT_MULTIPLIER 2.0f
+
+static RB_AABB aabb_union(const RB_AABB *a, const RB_AABB *b)
+{
+  RB_AABB c;
+  c.min.x = rb_min(a->min.x, b->min.x);
+  c.min.y = rb_min(a->min.y, b->min.y);
+  c.max.x = rb_max(a->max.x, b->max.x);
+  c.max.y = rb_max(a->max.y, b->max.y);
+  return c;
+}
+
+static RB_Scalar aabb_perimeter(const RB_AABB *a)
+{
+  return 2.0f * ((a->max.x - a->min.x) + (a->max.y - a->min.y));
+}
+
+static int aabb_contains(const RB_AABB *outer, const RB_AABB *inner)
+{
+  return outer->min.x <= inner->min.x && outer->min.y <= inner->min.y &&
+         inner->max.x <= outer->max.x && inner->max.y <= outer->max.y;
+}
+
+void rb_aabb_tree_init(RB_AABBTree *tree, RB_Scalar margin)
+{
+  memset(tree, 0, sizeof(*tree));
+  tree->root = RB_NULL_NODE;
+  tree->free_list = RB_NULL_NODE;
+  tree->margin = margin;
+}
+
+void rb_aabb_tree_free(RB_AABBTree *tree)
+{
+  free(tree->nodes);
+  rb_aabb_tree_init(tree, tree->margin);
+}
+
+static int allocate_node(RB_AABBTree *tree)
+{
+  if (tree->free_list == RB_NULL_NODE) {
+    int capacity = tree->node_capacity ? tree->node_capacity * 2 : 64;
+    RB_AABBTreeNode *nodes =
+        realloc(tree->nodes, (size_t)capacity * sizeof(RB_AABBTreeNode));
+    if (!nodes) {
+      return RB_NULL_NODE;
+    }
+    tree->nodes = nodes;
+
+    for (int i = tree->node_capacity; i < capacity; ++i) {
+      nodes[i].parent = i + 1 < capacity ? i + 1 : RB_NULL_NODE;
+      nodes[i].height = -1;
+    }
+    tree->free_list = tree->node_capacity;
+    tree->node_capacity = capacity;
+  }
+
+  int id = tree->free_list;
+  RB_AABBTreeNode *node = &tree->nodes[id];
+  tree->free_list = node->parent;
+  node->parent = RB_NULL_NODE;
+  node->child1 = RB_NULL_NODE;
+  node->child2 = RB_NULL_NODE;
+  node->height = 0;
+  node->user_index = -1;
+  node->kind = RB_PROXY_STATIC;
+  tree->node_count++;
+  return id;
+}
+
+static void free_node(RB_AABBTree *tree, int id)
+{
+  tree->nodes[id].parent = tree->free_list;
+  tree->nodes[id].height = -1;
+  tree->free_list = id;
+  tree->node_count--;
+}
+
+// AVL-style rotation: if a is imbalanced, promote its taller child.
+// Returns the new root of the subtree.
+static int balance(RB_AABBTree *tree, int ia)
+{
+  RB_AABBTreeNode *nodes = tree->nodes;
+  RB_AABBTreeNode *a = &nodes[ia];
+  if (a->height < 2) {
+    return ia;
+  }
+
+  int ib = a->child1;
+  int ic = a->child2;
+  RB_AABBTreeNode *b = &nodes[ib];
+  RB_AABBTreeNode *c = &nodes[ic];
+  int diff = c->height - b->height;
+
+  if (diff > 1 || diff < -1) {
+    // Rotate the taller child (up) above a.
+    int iup = diff > 0 ? ic : ib;
+    int iside = diff > 0 ? ib : ic;
+    RB_AABBTreeNode *up = &nodes[iup];
+    int i1 = up->child1;
+    int i2 = up->child2;
+    RB_AABBTreeNode *f = &nodes[i1];
+    RB_AABBTreeNode *g = &nodes[i2];
+
+    up->child1 = ia;
+    up->parent = a->parent;
+    a->parent = iup;
+
+    if (up->parent != RB_NULL_NODE) {
+      if (nodes[up->parent].child1 == ia) {
+        nodes[up->parent].child1 = iup;
+      } else {
+        nodes[up->parent].child2 = iup;
+      }
+    } else {
+      tree->root = iup;
+    }
+
+    // Keep the taller grandchild under up, hand the other one to a.
+    int keep = f->height > g->height ? i1 : i2;
+    int give = f->height > g->height ? i2 : i1;
+    up->child2 = keep;
+    if (diff > 0) {
+      a->child2 = give;
+    } else {
+      a->child1 = give;
+    }
+    nodes[give].parent = ia;
+
+    a->aabb = aabb_union(&nodes[iside].aabb, &nodes[give].aabb);
+    a->height = 1 + (nodes[iside].height > nodes[give].height
+                         ? nodes[iside].height
+                         : nodes[give].height);
+    up->aabb = aabb_union(&a->aabb, &nodes[keep].aabb);
+    up->height =
+        1 + (a->height > nodes[keep].height ? a->height : nodes[keep].height);
+    return iup;
+  }
+
+  return ia;
+}
+
+static void refit_ancestors(RB_AABBTree *tree, int index)
+{
+  RB_AABBTreeNode *nodes = tree->nodes;
+  while (index != RB_NULL_NODE) {
+    index = balance(tree, index);
+
+    int c1 = nodes[index].child1;
+    int c2 = nodes[index].child2;
+    nodes[index].height =
+        1 + (nodes[c1].height > nodes[c2].height ? nodes[c1].height
+                                                 : nodes[c2].height);
+    nodes[index].aabb = aabb_union(&nodes[c1].aabb, &nodes[c2].aabb);
+    index = nodes[index].parent;
+  }
+}
+
+// Returns -1 if the new parent node could not be allocated, the leaf is
+// then not in the tree.
+static int insert_leaf(RB_AABBTree *tree, int leaf)
+{
+  RB_AABBTreeNode *nodes = tree->nodes;
+  if (tree->root == RB_NULL_NODE) {
+    tree->root = leaf;
+    nodes[leaf].parent = RB_NULL_NODE;
+    return 0;
+  }
+
+  // Descend picking the child with the lowest perimeter increase
+  // (surface area heuristic in 2D).
+  RB_AABB leaf_aabb = nodes[leaf].aabb;
+  int index = tree->root;
+  while (nodes[index].height > 0) {
+    int c1 = nodes[index].child1;
+    int c2 = nodes[index].child2;
+
+    RB_Scalar area = aabb_perimeter(&nodes[index].aabb);
+    RB_AABB combined = aabb_union(&nodes[index].aabb, &leaf_aabb);
+    RB_Scalar combined_area = aabb_perimeter(&combined);
+    RB_Scalar cost = 2.0f * combined_area;
+    RB_Scalar inheritance_cost = 2.0f * (combined_area - area);
+
+    RB_Scalar cost1, cost2;
+    RB_AABB u1 = aabb_union(&leaf_aabb, &nodes[c1].aabb);
+    RB_AABB u2 = aabb_union(&leaf_aabb, &nodes[c2].aabb);
+    cost1 = aabb_perimeter(&u1) + inheritance_cost;
+    cost2 = aabb_perimeter(&u2) + inheritance_cost;
+    if (nodes[c1].height > 0) {
+      cost1 -= aabb_perimeter(&nodes[c1].aabb);
+    }
+    if (nodes[c2].height > 0) {
+      cost2 -= aabb_perimeter(&nodes[c2].aabb);
+    }
+
+    if (cost < cost1 && cost < cost2) {
+      break;
+    }
+    index = cost1 < cost2 ? c1 : c2;
+  }
+
+  int sibling = index;
+  int old_parent = nodes[sibling].parent;
+  int new_parent = allocate_node(tree);
+  if (new_parent == RB_NULL_NODE) {
+    return -1;
+  }
+  nodes = tree->nodes;
+
+  nodes[new_parent].parent = old_parent;
+  nodes[new_parent].aabb = aabb_union(&leaf_aabb, &nodes[sibling].aabb);
+  nodes[new_parent].height = nodes[sibling].height + 1;
+  nodes[new_parent].child1 = sibling;
+  nodes[new_parent].child2 = leaf;
+  nodes[sibling].parent = new_parent;
+  nodes[leaf].parent = new_parent;
+
+  if (old_parent != RB_NULL_NODE) {
+    if (nodes[old_parent].child1 == sibling) {
+      nodes[old_parent].child1 = new_parent;
+    } else {
+      nodes[old_parent].child2 = new_parent;
+    }
+  } else {
+    tree->root = new_parent;
+  }
+
+  refit_ancestors(tree, nodes[leaf].parent);
+  return 0;
+}
+
+static void remove_leaf(RB_AABBTree *tree, int leaf)
+{
+  RB_AABBTreeNode *nodes = tree->nodes;
+  if (leaf == tree->root) {
+    tree->root = RB_NULL_NODE;
+    return;
+  }
+
+  int parent = nodes[leaf].parent;
+  int grand_parent = nodes[parent].parent;
+  int sibling =
+      nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+  if (grand_parent != RB_NULL_NODE) {
+    if (nodes[grand_parent].child1 == parent) {
+      nodes[grand_parent].child1 = sibling;
+    } else {
+      nodes[grand_parent].child2 = sibling;
+    }
+    nodes[sibling].parent = grand_parent;
+    free_node(tree, parent);
+    refit_ancestors(tree, grand_parent);
+  } else {
+    tree->root = sibling;
+    nodes[sibling].parent = RB_NULL_NODE;
+    free_node(tree, parent);
+  }
+}
+
+static int insert_proxy(RB_AABBTree *tree, const RB_AABB *aabb,
+                        int user_index, RB_ProxyKind kind)
+{
+  int proxy = allocate_node(tree);
+  if (proxy == RB_NULL_NODE) {
+    return RB_NULL_NODE;
+  }
+
+  RB_AABBTreeNode *node = &tree->nodes[proxy];
+  node->aabb.min.x = aabb->min.x - tree->margin;
+  node->aabb.min.y = aabb->min.y - tree->margin;
+  node->aabb.max.x = aabb->max.x + tree->margin;
+  node->aabb.max.y = aabb->max.y + tree->margin;
+  node->user_index = user_index;
+  node->kind = kind;
+
+  if (insert_leaf(tree, proxy) != 0) {
+    free_node(tree, proxy);
+    return RB_NULL_NODE;
+  }
+  return proxy;
+}
+
+int rb_aabb_tree_insert(RB_AABBTree *tree, const RB_AABB *aabb,
+                        int user_index)
+{
+  return insert_proxy(tree, aabb, user_index, RB_PROXY_STATIC);
+}
+
+void rb_aabb_tree_remove(RB_AABBTree *tree, int proxy)
+{
+  remove_leaf(tree, proxy);
+  free_node(tree, proxy);
+}
+
+int rb_aabb_tree_move(RB_AABBTree *tree, int proxy, const RB_AABB *aabb,
+                      RB_Vector2 displacement)
+{
+  if (aabb_contains(&tree->nodes[proxy].aabb, aabb)) {
+    return 0;
+  }
+
+  remove_leaf(tree, proxy);
+
+  RB_AABB fat = {
+      {aabb->min.x - tree->margin, aabb->min.y - tree->margin},
+      {aabb->max.x + tree->margin, aabb->max.y + tree->margin},
+  };
+
+  // Predict motion so fast bones don't leave the fat box next step.
+  RB_Scalar dx = DISPLACEMENT_MULTIPLIER * displacement.x;
+  RB_Scalar dy = DISPLACEMENT_MULTIPLIER * displacement.y;
+  if (dx < 0) {
+    fat.min.x += dx;
+  } else {
+    fat.max.x += dx;
+  }
+  if (dy < 0) {
+    fat.min.y += dy;
+  } else {
+    fat.max.y += dy;
+  }
+
+  // Cannot fail: remove_leaf just freed the parent node this needs.
+  tree->nodes[proxy].aabb = fat;
+  insert_leaf(tree, proxy);
+  return 1;
+}
+
+void rb_aabb_tree_update_bones(RB_AABBTree *tree, const RB_Bone *bones,
+                               size_t bones_count, int *proxies, RB_Scalar dt)
+{
+  for (size_t i = 0; i < bones_count; ++i) {
+    const RB_Bone *bone = &bones[i];
+    RB_AABB aabb = rb_bone_aabb(bone);
+
+    if (proxies[i] == RB_NULL_NODE) {
+      proxies[i] = insert_proxy(tree, &aabb, (int)i, RB_PROXY_BONE);
+      continue;
+    }
+
+    RB_Vector2 displacement = {
+        (bone->joint1_velocity.x + bone->joint2_velocity.x) * 0.5f * dt,
+        (bone->joint1_velocity.y + bone->joint2_velocity.y) * 0.5f * dt,
+    };
+    rb_aabb_tree_move(tree, proxies[i], &aabb, displacement);
+  }
+}
+
+// Leaves of bone proxies are skipped when skip_bones is set.
+static int query_tree(const RB_AABBTree *tree, const RB_AABB *aabb,
+                      int skip_bones, RB_TreeQueryFn fn, void *user)
+{
+  int fixed[TREE_STACK_SIZE];
+  int *stack = fixed;
+  int capacity = TREE_STACK_SIZE;
+  int top = 0;
+  int result = 0;
+
+  if (tree->root == RB_NULL_NODE) {
+    return 0;
+  }
+  stack[top++] = tree->root;
+
+  while (top > 0) {
+    const RB_AABBTreeNode *node = &tree->nodes[stack[--top]];
+    if (!rb_aabb_overlap(&node->aabb, aabb)) {
+      continue;
+    }
+
+    if (node->height == 0) {
+      if (skip_bones && node->kind == RB_PROXY_BONE) {
+        continue;
+      }
+      if (!fn(node->user_index, user)) {
+        break;
+      }
+      continue;
+    }
+
+    if (top + 2 > capacity) {
+      // Only degenerate trees get this deep, move the stack to the heap.
+      int *grown = malloc((size_t)capacity * 2 * sizeof(int));
+      if (!grown) {
+        result = -1;
+        break;
+      }
+      memcpy(grown, stack, (size_t)top * sizeof(int));
+      if (stack != fixed) {
+        free(stack);
+      }
+      stack = grown;
+      capacity *= 2;
+    }
+    stack[top++] = node->child1;
+    stack[top++] = node->child2;
+  }
+
+  if (stack != fixed) {
+    free(stack);
+  }
+  return result;
+}
+
+int rb_aabb_tree_query(const RB_AABBTree *tree, const RB_AABB *aabb,
+                       RB_TreeQueryFn fn, void *user)
+{
+  return query_tree(tree, aabb, 0, fn, user);
+}
+
+typedef struct {
+  RB_PairBuffer *pairs;
+  uint32_t bone;
+  int failed;
+} BoneQuery;
+
+static int report_bone_pair(int user_index, void *user)
+{
+  BoneQuery *query = (BoneQuery *)user;
+  if (!rb_pair_buffer_push(query->pairs, query->bone, (uint32_t)user_index)) {
+    query->failed = 1;
+    return 0;
+  }
+  return 1;
+}
+
+int rb_aabb_tree_query_bones(const RB_AABBTree *tree, const RB_Bone *bones,
+                             size_t bones_count, RB_PairBuffer *pairs)
+{
+  pairs->count = 0;
+
+  for (size_t i = 0; i < bones_count; ++i) {
+    RB_AABB aabb = rb_bone_aabb(&bones[i]);
+    BoneQuery query = {pairs, (uint32_t)i, 0};
+    if (query_tree(tree, &aabb, 1, report_bone_pair, &query) || query.failed) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
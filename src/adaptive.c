@@ -0,0 +1,109 @@
+#include "rigidbodylib.h"
+#include "rb_math.h"
+#include <string.h>
+
+// Step size controller bounds: never change by more than these factors
+// between substeps, and aim a bit below tolerance so the next substep is
+// not rejected right away.
+#define MIN_FACTOR 0.25f
+#define MAX_FACTOR 2.0f
+#define SAFETY 0.9f
+
+int rb_adaptive_step_init(RB_AdaptiveStep *adaptive, size_t capacity,
+                          RB_Scalar min_dt, RB_Scalar max_dt,
+                          RB_Scalar tolerance)
+{
+  memset(adaptive, 0, sizeof(*adaptive));
+  // Also false for NaN. A zero min_dt would let substeps shrink to
+  // nothing and never finish the step.
+  if (!(min_dt > 0 && min_dt <= max_dt)) {
+    return -1;
+  }
+  adaptive->min_dt = min_dt;
+  adaptive->max_dt = max_dt;
+  adaptive->tolerance = tolerance;
+  adaptive->dt = max_dt;
+  adaptive->capacity = capacity;
+  adaptive->states = malloc(capacity * sizeof(RB_BoneState));
+  return adaptive->states || !capacity ? 0 : -1;
+}
+
+void rb_adaptive_step_free(RB_AdaptiveStep *adaptive)
+{
+  free(adaptive->states);
+  adaptive->states = 0;
+  adaptive->capacity = 0;
+}
+
+static RB_Scalar violation(const RB_Bone *bones, size_t bones_count)
+{
+  RB_Diagnostics diagnostics;
+  rb_compute_diagnostics(bones, bones_count, &diagnostics);
+  return rb_max(diagnostics.max_length_error,
+                diagnostics.max_joint_separation);
+}
+
+static RB_Scalar clamp(RB_Scalar v, RB_Scalar lo, RB_Scalar hi)
+{
+  return v < lo ? lo : v > hi ? hi : v;
+}
+
+// First order method, so the error shrinks about with dt squared.
+static RB_Scalar step_factor(const RB_AdaptiveStep *adaptive, RB_Scalar error)
+{
+  if (error != error) {
+    return MIN_FACTOR; // exploded
+  }
+  if (error <= 0) {
+    return MAX_FACTOR;
+  }
+  return clamp(SAFETY * rb_sqrt(adaptive->tolerance / error), MIN_FACTOR,
+               MAX_FACTOR);
+}
+
+int rb_update_bones_adaptive(RB_AdaptiveStep *adaptive, RB_Bone *bones,
+                             size_t bones_count, RB_Scalar dt)
+{
+  if (bones_count > adaptive->capacity || !(dt <= RB_SCALAR_MAX)) {
+    return -1;
+  }
+
+  adaptive->substeps = 0;
+  adaptive->rejected = 0;
+  RB_Scalar before = violation(bones, bones_count);
+  RB_Scalar remaining = dt;
+
+  while (remaining > 0) {
+    RB_Scalar planned = clamp(adaptive->dt, adaptive->min_dt, adaptive->max_dt);
+    RB_Scalar h = planned;
+    // Take the rest in one go instead of leaving a sliver.
+    if (remaining - h < adaptive->min_dt) {
+      h = remaining;
+    }
+
+    rb_bone_states_save(bones, bones_count, adaptive->states);
+    rb_update_bones(bones, bones_count, h);
+    RB_Scalar after = violation(bones, bones_count);
+    RB_Scalar error = after - before;
+    RB_Scalar factor = step_factor(adaptive, error);
+
+    // Written so that a NaN error counts as too large. Past the rejection
+    // limit substeps are kept whatever their error, so a scene that
+    // cannot meet the tolerance still finishes the step.
+    if (!(error <= adaptive->tolerance) && planned > adaptive->min_dt &&
+        adaptive->rejected < RB_ADAPTIVE_MAX_REJECTED) {
+      rb_bone_states_restore(bones, bones_count, adaptive->states);
+      // Shrink from the planned size so a stretched last substep cannot
+      // keep growing the retry.
+      adaptive->dt = rb_max(adaptive->min_dt, planned * factor);
+      adaptive->rejected++;
+      continue;
+    }
+
+    remaining -= h;
+    before = after;
+    adaptive->substeps++;
+    adaptive->dt = clamp(planned * factor, adaptive->min_dt, adaptive->max_dt);
+  }
+  return 0;
+}
@@ -0,0 +1,171 @@
+#include "rigidbodylib.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+// Triple buffer of positions between one stepping task (writer) and one
+// reader. The writer fills its back buffer and swaps it with latest; the
+// reader swaps its front buffer with latest when that holds a newer
+// frame. Each side owns its buffer outright, so neither waits.
+//
+// Steps run on a thread of their own rather than as a job: a job would
+// belong to the caller's job group, so the caller's next parallel_for
+// would also wait for the step, and with RB_Scheduler other threads
+// outside the pool would wait on it for the whole frame. The stepping
+// thread still hands the parallel parts of a step to the job system.
+
+#define BUFFER_MASK 3u
+#define FRESH 4u // latest holds a frame the reader has not taken yet
+
+struct RB_AsyncStep {
+  RB_World *world;
+  size_t bones_count;
+  size_t bones_capacity; // of the world, restored on destroy
+  RB_Scalar dt;
+  RB_Vector2 *positions[3];
+  uint64_t frames[3];
+  unsigned back;            // writer side
+  unsigned front;           // reader side
+  _Atomic unsigned latest;  // buffer index | FRESH
+
+  pthread_t thread;
+  int started;
+  pthread_mutex_t lock;
+  pthread_cond_t wake; // a step was requested, or stop
+  pthread_cond_t done; // pending went back to 0
+  int pending;         // a step was requested and has not finished
+  int stop;
+};
+
+static void publish(RB_AsyncStep *async)
+{
+  const RB_Bone *bones = async->world->bones;
+  RB_Vector2 *out = async->positions[async->back];
+  for (size_t i = 0; i < async->bones_count; ++i) {
+    out[i * 2] = bones[i].joint1_pos;
+    out[i * 2 + 1] = bones[i].joint2_pos;
+  }
+  async->frames[async->back] = async->world->frame;
+
+  // Release makes the positions visible before the index.
+  unsigned previous = atomic_exchange_explicit(
+      &async->latest, async->back | FRESH, memory_order_acq_rel);
+  async->back = previous & BUFFER_MASK;
+}
+
+static void *step_main(void *arg)
+{
+  RB_AsyncStep *async = arg;
+
+  pthread_mutex_lock(&async->lock);
+  for (;;) {
+    while (!async->pending && !async->stop) {
+      pthread_cond_wait(&async->wake, &async->lock);
+    }
+    if (!async->pending) {
+      break; // stop, with no step left to finish
+    }
+    pthread_mutex_unlock(&async->lock);
+
+    rb_world_step(async->world, async->dt);
+    publish(async);
+
+    pthread_mutex_lock(&async->lock);
+    async->pending = 0;
+    pthread_cond_broadcast(&async->done);
+  }
+  pthread_mutex_unlock(&async->lock);
+  return 0;
+}
+
+RB_AsyncStep *rb_async_step_create(RB_World *world)
+{
+  RB_AsyncStep *async = calloc(1, sizeof(RB_AsyncStep));
+  if (!async) {
+    return 0;
+  }
+  pthread_mutex_init(&async->lock, 0);
+  pthread_cond_init(&async->wake, 0);
+  pthread_cond_init(&async->done, 0);
+  async->world = world;
+  async->bones_count = world->bones_count;
+  // The buffers only hold bones_count bones, so spawns have to wait.
+  async->bones_capacity = world->bones_capacity;
+  world->bones_capacity = world->bones_count;
+  for (int i = 0; i < 3; ++i) {
+    async->positions[i] = malloc(world->bones_count * 2 * sizeof(RB_Vector2));
+    if (!async->positions[i] && world->bones_count) {
+      rb_async_step_destroy(async);
+      return 0;
+    }
+  }
+
+  async->back = 0;
+  async->front = 1;
+  atomic_init(&async->latest, 2);
+  publish(async); // the current state, so readers start with a frame
+
+  if (pthread_create(&async->thread, 0, step_main, async) != 0) {
+    rb_async_step_destroy(async);
+    return 0;
+  }
+  async->started = 1;
+  return async;
+}
+
+void rb_async_step_destroy(RB_AsyncStep *async)
+{
+  if (!async) {
+    return;
+  }
+  if (async->started) {
+    pthread_mutex_lock(&async->lock);
+    async->stop = 1;
+    pthread_cond_signal(&async->wake);
+    pthread_mutex_unlock(&async->lock);
+    pthread_join(async->thread, 0);
+  }
+  async->world->bones_capacity = async->bones_capacity;
+  pthread_cond_destroy(&async->done);
+  pthread_cond_destroy(&async->wake);
+  pthread_mutex_destroy(&async->lock);
+  for (int i = 0; i < 3; ++i) {
+    free(async->positions[i]);
+  }
+  free(async);
+}
+
+void rb_async_step(RB_AsyncStep *async, RB_Scalar dt)
+{
+  pthread_mutex_lock(&async->lock);
+  while (async->pending) {
+    pthread_cond_wait(&async->done, &async->lock);
+  }
+  async->dt = dt;
+  async->pending = 1;
+  pthread_cond_signal(&async->wake);
+  pthread_mutex_unlock(&async->lock);
+}
+
+void rb_async_step_wait(RB_AsyncStep *async)
+{
+  pthread_mutex_lock(&async->lock);
+  while (async->pending) {
+    pthread_cond_wait(&async->done, &async->lock);
+  }
+  pthread_mutex_unlock(&async->lock);
+}
+
+const RB_Vector2 *rb_async_positions(RB_AsyncStep *async, uint64_t *frame)
+{
+  if (atomic_load_explicit(&async->latest, memory_order_relaxed) & FRESH) {
+    // Acquire pairs with the release in publish.
+    unsigned previous = atomic_exchange_explicit(
+        &async->latest, async->front, memory_order_acq_rel);
+    async->front = previous & BUFFER_MASK;
+  }
+  if (frame) {
+    *frame = async->frames[async->front];
+  }
+  return async->positions[async->front];
+}
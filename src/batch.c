@@ -0,0 +1,310 @@
+#include "rigidbodylib.h"
+#include "rb_math.h"
+#include "rb_profile.h"
+#include <string.h>
+
+// Worlds stepped together share the bone links, so every loop below runs
+// the same bone order for all lanes and the inner lane loops vectorize.
+// Selects replace the mass and distance branches of the scalar kernels.
+
+#define LANES RB_WORLD_LANES
+
+typedef struct {
+  RB_Scalar x[LANES];
+  RB_Scalar y[LANES];
+} LaneVector;
+
+typedef struct {
+  LaneVector joint1_pos;
+  LaneVector joint2_pos;
+  LaneVector joint1_force;
+  LaneVector joint2_force;
+  LaneVector joint1_velocity;
+  LaneVector joint2_velocity;
+  RB_Scalar joint1_mass[LANES];
+  RB_Scalar joint2_mass[LANES];
+  RB_Scalar length[LANES];
+} LaneBone;
+
+typedef struct {
+  size_t bones_count;
+  int parent[RB_WORLD_LANES_MAX_BONES]; // index of joint1, -1 if none
+  int child[RB_WORLD_LANES_MAX_BONES];  // index of joint2, -1 if none
+  LaneBone bones[RB_WORLD_LANES_MAX_BONES];
+} LaneWorlds;
+
+static int link_index(const RB_World *world, const void *link)
+{
+  if (!link) {
+    return -1;
+  }
+  size_t i = (size_t)((const RB_Bone *)link - world->bones);
+  return i < world->bones_count ? (int)i : -2;
+}
+
+// Worlds with a rollback buffer, diagnostics, islands or CCD bones take
+// the regular rb_world_step.
+static int batchable(const RB_World *world)
+{
+  if (world->rollback || world->diagnostics || world->islands ||
+      world->bones_count > RB_WORLD_LANES_MAX_BONES) {
+    return 0;
+  }
+  for (size_t i = 0; i < world->bones_count; ++i) {
+    const RB_Bone *bone = &world->bones[i];
+    if ((bone->flags & RB_BONE_CCD) || link_index(world, bone->joint1) == -2 ||
+        link_index(world, bone->joint2) == -2) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int same_links(const RB_World *a, const RB_World *b)
+{
+  if (a->bones_count != b->bones_count) {
+    return 0;
+  }
+  for (size_t i = 0; i < a->bones_count; ++i) {
+    if (link_index(a, a->bones[i].joint1) !=
+            link_index(b, b->bones[i].joint1) ||
+        link_index(a, a->bones[i].joint2) !=
+            link_index(b, b->bones[i].joint2)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void gather(LaneWorlds *lanes, RB_World *const *worlds, int count)
+{
+  const RB_World *first = worlds[0];
+  lanes->bones_count = first->bones_count;
+  for (size_t i = 0; i < first->bones_count; ++i) {
+    lanes->parent[i] = link_index(first, first->bones[i].joint1);
+    lanes->child[i] = link_index(first, first->bones[i].joint2);
+  }
+
+  // Unused lanes repeat the last world, so they hold sane numbers.
+  for (int lane = 0; lane < LANES; ++lane) {
+    const RB_World *world = worlds[lane < count ? lane : count - 1];
+    for (size_t i = 0; i < world->bones_count; ++i) {
+      const RB_Bone *bone = &world->bones[i];
+      LaneBone *b = &lanes->bones[i];
+      b->joint1_pos.x[lane] = bone->joint1_pos.x;
+      b->joint1_pos.y[lane] = bone->joint1_pos.y;
+      b->joint2_pos.x[lane] = bone->joint2_pos.x;
+      b->joint2_pos.y[lane] = bone->joint2_pos.y;
+      b->joint1_velocity.x[lane] = bone->joint1_velocity.x;
+      b->joint1_velocity.y[lane] = bone->joint1_velocity.y;
+      b->joint2_velocity.x[lane] = bone->joint2_velocity.x;
+      b->joint2_velocity.y[lane] = bone->joint2_velocity.y;
+      b->joint1_mass[lane] = bone->joint1_mass;
+      b->joint2_mass[lane] = bone->joint2_mass;
+      b->length[lane] = bone->length;
+    }
+  }
+}
+
+static void scatter(const LaneWorlds *lanes, RB_World *const *worlds,
+                    int count)
+{
+  for (int lane = 0; lane < count; ++lane) {
+    RB_World *world = worlds[lane];
+    for (size_t i = 0; i < world->bones_count; ++i) {
+      RB_Bone *bone = &world->bones[i];
+      const LaneBone *b = &lanes->bones[i];
+      bone->joint1_pos.x = b->joint1_pos.x[lane];
+      bone->joint1_pos.y = b->joint1_pos.y[lane];
+      bone->joint2_pos.x = b->joint2_pos.x[lane];
+      bone->joint2_pos.y = b->joint2_pos.y[lane];
+      bone->joint1_force.x = b->joint1_force.x[lane];
+      bone->joint1_force.y = b->joint1_force.y[lane];
+      bone->joint2_force.x = b->joint2_force.x[lane];
+      bone->joint2_force.y = b->joint2_force.y[lane];
+      bone->joint1_velocity.x = b->joint1_velocity.x[lane];
+      bone->joint1_velocity.y = b->joint1_velocity.y[lane];
+      bone->joint2_velocity.x = b->joint2_velocity.x[lane];
+      bone->joint2_velocity.y = b->joint2_velocity.y[lane];
+    }
+  }
+}
+
+// rb_calculate_object_resistance_force with the RB_DETERMINISTIC angle.
+static void lane_resistance_force(LaneBone *b)
+{
+  RB_Scalar spring = rb_global_config.spring_scale;
+  RB_Scalar damping = rb_global_config.damping_scale;
+
+  for (int l = 0; l < LANES; ++l) {
+    RB_Scalar dx = b->joint2_pos.x[l] - b->joint1_pos.x[l];
+    RB_Scalar dy = b->joint2_pos.y[l] - b->joint1_pos.y[l];
+    RB_Scalar distance = rb_sqrt(dx * dx + dy * dy);
+    RB_Scalar safe = distance > 0 ? distance : 1;
+    RB_Scalar cos_angle = dx / safe;
+    RB_Scalar sin_angle = dy / safe;
+    cos_angle = distance > 0 ? cos_angle : 1;
+    sin_angle = distance > 0 ? sin_angle : 0;
+
+    RB_Scalar rel_vel =
+        ((b->joint2_velocity.x[l] - b->joint1_velocity.x[l]) * cos_angle +
+         (b->joint2_velocity.y[l] - b->joint1_velocity.y[l]) * sin_angle);
+    RB_Scalar force =
+        spring * (distance - b->length[l]) + damping * rel_vel;
+
+    b->joint1_force.x[l] = force * cos_angle;
+    b->joint1_force.y[l] = force * sin_angle;
+    b->joint2_force.x[l] = -force * cos_angle;
+    b->joint2_force.y[l] = -force * sin_angle;
+  }
+}
+
+static void lane_joint_constraint(LaneBone *parent, LaneBone *child,
+                                  RB_Scalar dt)
+{
+  RB_Scalar damping = rb_global_config.damping_scale;
+
+  for (int l = 0; l < LANES; ++l) {
+    RB_Scalar ex = child->joint1_pos.x[l] - parent->joint2_pos.x[l];
+    RB_Scalar ey = child->joint1_pos.y[l] - parent->joint2_pos.y[l];
+    RB_Scalar distance = rb_sqrt(ex * ex + ey * ey);
+    RB_Scalar correction_factor = (distance - child->length[l]) * 0.5f;
+
+    // Dividing by 1 leaves ex, ey as they are, like the skipped division.
+    RB_Scalar safe = distance > 0 ? distance : 1;
+    ex /= safe;
+    ey /= safe;
+
+    parent->joint2_pos.x[l] -= correction_factor * ex * dt;
+    parent->joint2_pos.y[l] -= correction_factor * ey * dt;
+    child->joint1_pos.x[l] += correction_factor * ex * dt;
+    child->joint1_pos.y[l] += correction_factor * ey * dt;
+
+    RB_Scalar vx = damping * (child->joint1_velocity.x[l] -
+                              parent->joint2_velocity.x[l]);
+    RB_Scalar vy = damping * (child->joint1_velocity.y[l] -
+                              parent->joint2_velocity.y[l]);
+
+    parent->joint2_velocity.x[l] += vx * 0.5f * dt;
+    parent->joint2_velocity.y[l] += vy * 0.5f * dt;
+    child->joint1_velocity.x[l] -= vx * 0.5f * dt;
+    child->joint1_velocity.y[l] -= vy * 0.5f * dt;
+  }
+}
+
+// Gravity and forces into velocity of one joint.
+static void lane_integrate(LaneVector *velocity, const LaneVector *force,
+                           const RB_Scalar *mass, RB_Scalar dt)
+{
+  RB_Scalar gravity = rb_global_config.gravity_scale;
+
+  for (int l = 0; l < LANES; ++l) {
+    RB_Scalar m = mass[l] != 0 ? mass[l] : 1;
+    RB_Scalar vx = velocity->x[l] + force->x[l] / m * dt;
+    RB_Scalar vy = velocity->y[l] + gravity * dt;
+    vy += force->y[l] / m * dt;
+    velocity->x[l] = mass[l] != 0 ? vx : velocity->x[l];
+    velocity->y[l] = mass[l] != 0 ? vy : velocity->y[l];
+  }
+}
+
+static void lane_move(LaneVector *pos, const LaneVector *velocity,
+                      RB_Scalar dt)
+{
+  for (int l = 0; l < LANES; ++l) {
+    pos->x[l] += velocity->x[l] * dt;
+    pos->y[l] += velocity->y[l] * dt;
+  }
+}
+
+// rb_pre_update_bones followed by rb_update_bone on every bone, the same
+// order as rb_update_bones.
+static void lane_step(LaneWorlds *lanes, RB_Scalar dt)
+{
+  size_t n = lanes->bones_count;
+  LaneBone *bones = lanes->bones;
+
+  for (size_t i = 0; i < n; ++i) {
+    lane_resistance_force(&bones[i]);
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    LaneBone *b = &bones[i];
+    lane_resistance_force(b);
+    if (lanes->parent[i] >= 0) {
+      lane_joint_constraint(&bones[lanes->parent[i]], b, dt);
+    }
+    if (lanes->child[i] >= 0) {
+      lane_joint_constraint(b, &bones[lanes->child[i]], dt);
+    }
+    lane_integrate(&b->joint1_velocity, &b->joint1_force, b->joint1_mass, dt);
+    lane_integrate(&b->joint2_velocity, &b->joint2_force, b->joint2_mass, dt);
+    lane_move(&b->joint1_pos, &b->joint1_velocity, dt);
+    lane_move(&b->joint2_pos, &b->joint2_velocity, dt);
+  }
+}
+
+typedef struct {
+  RB_World *worlds;
+  size_t count;
+  RB_Scalar dt;
+} StepTask;
+
+// begin_block and end_block count blocks of LANES worlds.
+static void step_range(void *data, uint32_t begin_block, uint32_t end_block)
+{
+  StepTask *task = data;
+  RB_World *worlds = task->worlds;
+  LaneWorlds lanes;
+  RB_World *group[LANES];
+  size_t begin = (size_t)begin_block * LANES;
+  size_t end = (size_t)end_block * LANES;
+  if (end > task->count) {
+    end = task->count;
+  }
+
+  // Commands may change links, drain before grouping by them.
+  for (size_t i = begin; i < end; ++i) {
+    if (worlds[i].commands) {
+      rb_command_queue_drain(worlds[i].commands, &worlds[i]);
+    }
+  }
+
+  size_t i = begin;
+  while (i < end) {
+    if (!batchable(&worlds[i])) {
+      rb_world_step(&worlds[i], task->dt);
+      i++;
+      continue;
+    }
+
+    // Runs of worlds with the same links share a batch.
+    int size = 0;
+    group[size++] = &worlds[i++];
+    while (size < LANES && i < end && batchable(&worlds[i]) &&
+           same_links(group[0], &worlds[i])) {
+      group[size++] = &worlds[i++];
+    }
+
+    gather(&lanes, group, size);
+    lane_step(&lanes, task->dt);
+    scatter(&lanes, group, size);
+    for (int lane = 0; lane < size; ++lane) {
+      memset(&group[lane]->stats, 0, sizeof(group[lane]->stats));
+      group[lane]->frame++;
+    }
+  }
+}
+
+void rb_step_worlds(RB_World *worlds, size_t count, RB_Scalar dt)
+{
+#ifdef RB_ENABLE_TRACE
+  double start = rb_profile_now();
+#endif
+  // Ranges are split between blocks of LANES worlds, never inside one, so
+  // runs that start on a block boundary are not cut short.
+  StepTask task = {worlds, count, dt};
+  size_t blocks = (count + LANES - 1) / LANES;
+  rb_parallel_for(step_range, &task, (uint32_t)blocks, 8);
+  RB_TRACE("step worlds", "worlds", (int64_t)count, start, rb_profile_now());
+}
@@ -0,0 +1,145 @@
+#include "rigidbodylib.h"
+#include "rb_math.h"
+#include <string.h>
+
+RB_AABB rb_bone_aabb(const RB_Bone *bone)
+{
+  RB_AABB aabb;
+  aabb.min.x = rb_min(bone->joint1_pos.x, bone->joint2_pos.x);
+  aabb.min.y = rb_min(bone->joint1_pos.y, bone->joint2_pos.y);
+  aabb.max.x = rb_max(bone->joint1_pos.x, bone->joint2_pos.x);
+  aabb.max.y = rb_max(bone->joint1_pos.y, bone->joint2_pos.y);
+  return aabb;
+}
+
+int rb_aabb_overlap(const RB_AABB *a, const RB_AABB *b)
+{
+  return a->min.x <= b->max.x && b->min.x <= a->max.x &&
+         a->min.y <= b->max.y && b->min.y <= a->max.y;
+}
+
+void rb_pair_buffer_free(RB_PairBuffer *buffer)
+{
+  free(buffer->pairs);
+  buffer->pairs = 0;
+  buffer->count = 0;
+  buffer->capacity = 0;
+}
+
+int rb_pair_buffer_push(RB_PairBuffer *buffer, uint32_t a, uint32_t b)
+{
+  if (buffer->count == buffer->capacity) {
+    size_t capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+    RB_Pair *pairs = realloc(buffer->pairs, capacity * sizeof(RB_Pair));
+    if (!pairs) {
+      return 0;
+    }
+    buffer->pairs = pairs;
+    buffer->capacity = capacity;
+  }
+
+  RB_Pair *pair = &buffer->pairs[buffer->count++];
+  pair->a = a;
+  pair->b = b;
+  return 1;
+}
+
+static int bones_linked(const RB_Bone *a, const RB_Bone *b)
+{
+  return a->joint1 == b || a->joint2 == b || b->joint1 == a ||
+         b->joint2 == a;
+}
+
+void rb_sap_init(RB_SweepAndPrune *sap)
+{
+  memset(sap, 0, sizeof(*sap));
+}
+
+void rb_sap_free(RB_SweepAndPrune *sap)
+{
+  free(sap->entries);
+  memset(sap, 0, sizeof(*sap));
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+  RB_Scalar ax = ((const RB_SapEntry *)a)->aabb.min.x;
+  RB_Scalar bx = ((const RB_SapEntry *)b)->aabb.min.x;
+  return (ax > bx) - (ax < bx);
+}
+
+// Bone count changed, so the previous order is meaningless.
+// Start over from a full sort.
+static int sap_rebuild(RB_SweepAndPrune *sap, const RB_Bone *bones,
+                       size_t bones_count)
+{
+  if (bones_count > sap->capacity) {
+    RB_SapEntry *entries =
+        realloc(sap->entries, bones_count * sizeof(RB_SapEntry));
+    if (!entries) {
+      return 0;
+    }
+    sap->entries = entries;
+    sap->capacity = bones_count;
+  }
+
+  for (size_t i = 0; i < bones_count; ++i) {
+    sap->entries[i].index = (uint32_t)i;
+    sap->entries[i].aabb = rb_bone_aabb(&bones[i]);
+  }
+  qsort(sap->entries, bones_count, sizeof(RB_SapEntry), compare_entries);
+  sap->count = bones_count;
+  return 1;
+}
+
+size_t rb_sap_update(RB_SweepAndPrune *sap, const RB_Bone *bones,
+                     size_t bones_count, RB_PairBuffer *pairs)
+{
+  pairs->count = 0;
+
+  if (bones_count != sap->count) {
+    if (!sap_rebuild(sap, bones, bones_count)) {
+      return 0;
+    }
+  } else {
+    for (size_t i = 0; i < bones_count; ++i) {
+      RB_SapEntry *entry = &sap->entries[i];
+      entry->aabb = rb_bone_aabb(&bones[entry->index]);
+    }
+
+    // Insertion sort: bones barely move between steps, so almost every
+    // entry is already in place and this stays close to O(n).
+    for (size_t i = 1; i < bones_count; ++i) {
+      RB_SapEntry entry = sap->entries[i];
+      size_t j = i;
+      while (j > 0 && sap->entries[j - 1].aabb.min.x > entry.aabb.min.x) {
+        sap->entries[j] = sap->entries[j - 1];
+        --j;
+      }
+      sap->entries[j] = entry;
+    }
+  }
+
+  for (size_t i = 0; i < bones_count; ++i) {
+    const RB_SapEntry *a = &sap->entries[i];
+    for (size_t j = i + 1; j < bones_count; ++j) {
+      const RB_SapEntry *b = &sap->entries[j];
+      if (b->aabb.min.x > a->aabb.max.x) {
+        break;
+      }
+      if (a->aabb.min.y > b->aabb.max.y || b->aabb.min.y > a->aabb.max.y) {
+        continue;
+      }
+      if (bones_linked(&bones[a->index], &bones[b->index])) {
+        continue;
+      }
+      uint32_t lo = a->index < b->index ? a->index : b->index;
+      uint32_t hi = a->index < b->index ? b->index : a->index;
+      if (!rb_pair_buffer_push(pairs, lo, hi)) {
+        return pairs->count;
+      }
+    }
+  }
+
+  return pairs->count;
+}
@@ -0,0 +1,199 @@
+#include "rigidbodylib.h"
+#include "rb_math.h"
+
+#define CCD_MAX_ITERATIONS 16
+#define CCD_SLOP 0.01f
+
+static const RB_Collider *rb_static_colliders;
+static size_t rb_static_colliders_count;
+
+void rb_set_static_colliders(const RB_Collider *colliders, size_t count)
+{
+  rb_static_colliders = colliders;
+  rb_static_colliders_count = colliders ? count : 0;
+}
+
+static RB_Scalar box_distance(const RB_AABB *box, RB_Vector2 p,
+                              RB_Vector2 *normal)
+{
+  RB_Scalar cx = rb_min(rb_max(p.x, box->min.x), box->max.x);
+  RB_Scalar cy = rb_min(rb_max(p.y, box->min.y), box->max.y);
+  RB_Scalar dx = p.x - cx;
+  RB_Scalar dy = p.y - cy;
+
+  if (dx != 0 || dy != 0) {
+    RB_Scalar distance = rb_sqrt(dx * dx + dy * dy);
+    normal->x = dx / distance;
+    normal->y = dy / distance;
+    return distance;
+  }
+
+  // Inside: push out through the nearest face.
+  RB_Scalar left = p.x - box->min.x;
+  RB_Scalar right = box->max.x - p.x;
+  RB_Scalar top = p.y - box->min.y;
+  RB_Scalar bottom = box->max.y - p.y;
+  RB_Scalar depth = rb_min(rb_min(left, right), rb_min(top, bottom));
+
+  normal->x = 0;
+  normal->y = 0;
+  if (depth == left) {
+    normal->x = -1;
+  } else if (depth == right) {
+    normal->x = 1;
+  } else if (depth == top) {
+    normal->y = -1;
+  } else {
+    normal->y = 1;
+  }
+  return -depth;
+}
+
+RB_Scalar rb_collider_distance(const RB_Collider *collider, RB_Vector2 p,
+                               RB_Vector2 *normal)
+{
+  switch (collider->type) {
+  case RB_COLLIDER_PLANE:
+    *normal = collider->normal;
+    return collider->normal.x * p.x + collider->normal.y * p.y -
+           collider->offset;
+  case RB_COLLIDER_BOX:
+    return box_distance(&collider->box, p, normal);
+  }
+  return INFINITY;
+}
+
+static RB_Scalar closest_collider(RB_Vector2 p, RB_Vector2 *normal)
+{
+  RB_Scalar best = INFINITY;
+  for (size_t i = 0; i < rb_static_colliders_count; ++i) {
+    RB_Vector2 n = {0, 0};
+    RB_Scalar distance = rb_collider_distance(&rb_static_colliders[i], p, &n);
+    if (distance < best) {
+      best = distance;
+      *normal = n;
+    }
+  }
+  return best;
+}
+
+// Fraction of the move from p by d at which p enters collider, or a value
+// above 1 if it does not. Used when conservative advancement gives up.
+static RB_Scalar collider_toi(const RB_Collider *collider, RB_Vector2 p,
+                              RB_Vector2 d)
+{
+  switch (collider->type) {
+  case RB_COLLIDER_PLANE: {
+    RB_Vector2 n = collider->normal;
+    RB_Scalar d0 = n.x * p.x + n.y * p.y - collider->offset;
+    RB_Scalar d1 = d0 + n.x * d.x + n.y * d.y;
+    if (d0 < 0 || d1 >= 0) {
+      return 2;
+    }
+    return d0 / (d0 - d1);
+  }
+  case RB_COLLIDER_BOX: {
+    const RB_AABB *box = &collider->box;
+    RB_Scalar enter = 0;
+    RB_Scalar exit = 1;
+    RB_Scalar origin[2] = {p.x, p.y};
+    RB_Scalar delta[2] = {d.x, d.y};
+    RB_Scalar min[2] = {box->min.x, box->min.y};
+    RB_Scalar max[2] = {box->max.x, box->max.y};
+    for (int axis = 0; axis < 2; ++axis) {
+      if (delta[axis] == 0) {
+        if (origin[axis] < min[axis] || origin[axis] > max[axis]) {
+          return 2;
+        }
+        continue;
+      }
+      RB_Scalar t1 = (min[axis] - origin[axis]) / delta[axis];
+      RB_Scalar t2 = (max[axis] - origin[axis]) / delta[axis];
+      enter = rb_max(enter, rb_min(t1, t2));
+      exit = rb_min(exit, rb_max(t1, t2));
+    }
+    return enter <= exit ? enter : 2;
+  }
+  }
+  return 2;
+}
+
+int rb_sweep_joint(RB_Vector2 *pos, RB_Vector2 *velocity, RB_Scalar dt)
+{
+  RB_Vector2 normal = {0, 0};
+  RB_Scalar speed =
+      rb_sqrt(velocity->x * velocity->x + velocity->y * velocity->y);
+  RB_Scalar t = 0;
+  int hit = 0;
+
+  // Conservative advancement: with static colliders nothing can get
+  // closer than distance / speed in that time, so step by exactly that
+  // until the joint touches or the step is used up.
+  for (int i = 0; i < CCD_MAX_ITERATIONS; ++i) {
+    RB_Scalar distance = closest_collider(*pos, &normal);
+    if (distance < CCD_SLOP) {
+      hit = 1;
+      // Snap onto the surface; this also resolves penetration left over
+      // from joint position corrections.
+      pos->x -= distance * normal.x;
+      pos->y -= distance * normal.y;
+      break;
+    }
+    if (speed == 0) {
+      break;
+    }
+
+    RB_Scalar step = distance / speed;
+    if (t + step >= dt) {
+      step = dt - t;
+    }
+    pos->x += velocity->x * step;
+    pos->y += velocity->y * step;
+    t += step;
+    if (t >= dt) {
+      break;
+    }
+  }
+
+  // Ran out of iterations while grazing or closing in on a surface:
+  // sweep the rest of the step exactly instead of dropping it.
+  if (!hit && t < dt && speed != 0) {
+    RB_Scalar rest = dt - t;
+    RB_Vector2 move = {velocity->x * rest, velocity->y * rest};
+    RB_Scalar toi = 1;
+    for (size_t i = 0; i < rb_static_colliders_count; ++i) {
+      toi = rb_min(toi, collider_toi(&rb_static_colliders[i], *pos, move));
+    }
+    pos->x += move.x * toi;
+    pos->y += move.y * toi;
+    t += rest * toi;
+
+    RB_Scalar distance = closest_collider(*pos, &normal);
+    if (toi < 1 || distance < CCD_SLOP) {
+      hit = 1;
+      pos->x -= distance * normal.x;
+      pos->y -= distance * normal.y;
+    }
+  }
+
+  if (!hit) {
+    return 0;
+  }
+
+  RB_Scalar normal_velocity = velocity->x * normal.x + velocity->y * normal.y;
+  if (normal_velocity < 0) {
+    velocity->x -= normal_velocity * normal.x;
+    velocity->y -= normal_velocity * normal.y;
+  }
+
+  pos->x += velocity->x * (dt - t);
+  pos->y += velocity->y * (dt - t);
+
+  // Sliding may still graze a neighbouring collider; project back out.
+  RB_Scalar distance = closest_collider(*pos, &normal);
+  if (distance < 0) {
+    pos->x -= distance * normal.x;
+    pos->y -= distance * normal.y;
+  }
+  return 1;
+}
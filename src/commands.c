@@ -0,0 +1,198 @@
+#include "rigidbodylib.h"
+#include <stdatomic.h>
+
+// Bounded multi-producer queue after Vyukov: every slot carries a
+// sequence number telling whose turn it is. A producer claims the tail
+// with a CAS and publishes the slot by bumping its sequence; the single
+// consumer takes slots in claim order and stops at the first one not
+// published yet. Producers never wait on each other or on the consumer,
+// a full queue just refuses the command.
+
+typedef struct {
+  _Atomic size_t sequence;
+  RB_Command command;
+} Slot;
+
+struct RB_CommandQueue {
+  Slot *slots;
+  size_t mask;
+  _Atomic size_t tail;
+  char pad[64];
+  size_t head; // consumer only
+};
+
+RB_CommandQueue *rb_command_queue_create(size_t capacity)
+{
+  size_t size = 2;
+  while (size < capacity) {
+    size *= 2;
+  }
+
+  RB_CommandQueue *queue = calloc(1, sizeof(RB_CommandQueue));
+  Slot *slots = malloc(size * sizeof(Slot));
+  if (!queue || !slots) {
+    free(queue);
+    free(slots);
+    return 0;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    atomic_init(&slots[i].sequence, i);
+  }
+  queue->slots = slots;
+  queue->mask = size - 1;
+  atomic_init(&queue->tail, 0);
+  return queue;
+}
+
+void rb_command_queue_destroy(RB_CommandQueue *queue)
+{
+  if (queue) {
+    free(queue->slots);
+    free(queue);
+  }
+}
+
+int rb_command_push(RB_CommandQueue *queue, const RB_Command *command)
+{
+  size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  for (;;) {
+    Slot *slot = &queue->slots[pos & queue->mask];
+    size_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        slot->command = *command;
+        atomic_store_explicit(&slot->sequence, pos + 1,
+                              memory_order_release);
+        return 0;
+      }
+    } else if (diff < 0) {
+      return -1; // full, the consumer has not freed this slot yet
+    } else {
+      pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    }
+  }
+}
+
+int rb_command_impulse(RB_CommandQueue *queue, uint32_t bone, int joint,
+                       RB_Vector2 impulse)
+{
+  RB_Command command = {RB_COMMAND_IMPULSE, bone, 0, joint, impulse, {0}};
+  return rb_command_push(queue, &command);
+}
+
+int rb_command_spawn(RB_CommandQueue *queue, const RB_Bone *bone,
+                     uint32_t parent)
+{
+  RB_Command command = {RB_COMMAND_SPAWN, 0, parent, 0, {0, 0}, *bone};
+  return rb_command_push(queue, &command);
+}
+
+int rb_command_connect(RB_CommandQueue *queue, uint32_t parent, uint32_t child)
+{
+  RB_Command command = {RB_COMMAND_CONNECT, child, parent, 0, {0, 0}, {0}};
+  return rb_command_push(queue, &command);
+}
+
+int rb_command_disconnect(RB_CommandQueue *queue, uint32_t bone)
+{
+  RB_Command command = {RB_COMMAND_DISCONNECT, bone, 0, 0, {0, 0}, {0}};
+  return rb_command_push(queue, &command);
+}
+
+static void disconnect(RB_Bone *bone)
+{
+  RB_Bone *parent = bone->joint1;
+  if (parent && parent->joint2 == bone) {
+    parent->joint2 = 0;
+  }
+  bone->joint1 = 0;
+}
+
+// A parent has one child, so the one it had before loses its parent.
+static void connect(RB_Bone *parent, RB_Bone *child)
+{
+  RB_Bone *previous = parent->joint2;
+  if (previous && previous != child && previous->joint1 == parent) {
+    previous->joint1 = 0;
+  }
+  rb_connect_bone(parent, child);
+}
+
+// Returns 1 if the command changed links or the bone count.
+static int apply(RB_World *world, const RB_Command *command)
+{
+  RB_Bone *bones = world->bones;
+  size_t count = world->bones_count;
+
+  switch (command->type) {
+  case RB_COMMAND_IMPULSE:
+    if (command->bone < count) {
+      rb_apply_impulse(&bones[command->bone], command->joint,
+                       command->impulse);
+    }
+    return 0;
+  case RB_COMMAND_SPAWN: {
+    if (count >= world->bones_capacity) {
+      return 0;
+    }
+    RB_Bone *bone = &bones[count];
+    *bone = command->spawn;
+    bone->joint1 = 0;
+    bone->joint2 = 0;
+    if (command->other < count) {
+      connect(&bones[command->other], bone);
+    } else if (bone->length == 0) {
+      bone->length = rb_calculate_distance(&bone->joint1_pos,
+                                           &bone->joint2_pos);
+    }
+    world->bones_count++;
+    return 1;
+  }
+  case RB_COMMAND_CONNECT:
+    if (command->bone < count && command->other < count &&
+        command->bone != command->other) {
+      disconnect(&bones[command->bone]);
+      connect(&bones[command->other], &bones[command->bone]);
+      return 1;
+    }
+    return 0;
+  case RB_COMMAND_DISCONNECT:
+    if (command->bone < count) {
+      disconnect(&bones[command->bone]);
+      return 1;
+    }
+    return 0;
+  }
+  return 0;
+}
+
+size_t rb_command_queue_drain(RB_CommandQueue *queue, RB_World *world)
+{
+  size_t applied = 0;
+  int relinked = 0;
+
+  for (;;) {
+    Slot *slot = &queue->slots[queue->head & queue->mask];
+    size_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (sequence != queue->head + 1) {
+      break; // empty, or the next command is still being written
+    }
+
+    relinked |= apply(world, &slot->command);
+    applied++;
+    atomic_store_explicit(&slot->sequence, queue->head + queue->mask + 1,
+                          memory_order_release);
+    queue->head++;
+  }
+
+  if (relinked && world->islands) {
+    rb_islands_build(world->islands, world->bones, world->bones_count);
+  }
+  return applied;
+}
@@ -0,0 +1,96 @@
+#include "rigidbodylib.h"
+#include "rb_math.h"
+#include <string.h>
+
+#define LANES 8
+
+// Bones are gathered lane-wise in blocks of LANES, so the per lane math
+// and the accumulators below are plain loops the compiler turns into SIMD.
+// Unused lanes of the last block hold zeros, which add nothing.
+typedef struct {
+  RB_Scalar x1[LANES], y1[LANES], x2[LANES], y2[LANES];
+  RB_Scalar vx1[LANES], vy1[LANES], vx2[LANES], vy2[LANES];
+  RB_Scalar m1[LANES], m2[LANES];
+  RB_Scalar length[LANES];
+  RB_Scalar px[LANES], py[LANES]; // parent joint2, own joint1 without one
+} BoneBlock;
+
+static void gather(const RB_Bone *bones, size_t count, BoneBlock *block)
+{
+  if (count < LANES) {
+    memset(block, 0, sizeof(*block));
+  }
+  for (size_t i = 0; i < count; ++i) {
+    const RB_Bone *bone = &bones[i];
+    const RB_Bone *parent = (const RB_Bone *)bone->joint1;
+    RB_Vector2 anchor = parent ? parent->joint2_pos : bone->joint1_pos;
+
+    block->x1[i] = bone->joint1_pos.x;
+    block->y1[i] = bone->joint1_pos.y;
+    block->x2[i] = bone->joint2_pos.x;
+    block->y2[i] = bone->joint2_pos.y;
+    block->vx1[i] = bone->joint1_velocity.x;
+    block->vy1[i] = bone->joint1_velocity.y;
+    block->vx2[i] = bone->joint2_velocity.x;
+    block->vy2[i] = bone->joint2_velocity.y;
+    block->m1[i] = bone->joint1_mass;
+    block->m2[i] = bone->joint2_mass;
+    block->length[i] = bone->length;
+    block->px[i] = anchor.x;
+    block->py[i] = anchor.y;
+  }
+}
+
+void rb_compute_diagnostics(const RB_Bone *bones, size_t bones_count,
+                            RB_Diagnostics *diagnostics)
+{
+  RB_Scalar max_error[LANES] = {0};
+  RB_Scalar sum_error[LANES] = {0};
+  RB_Scalar max_separation[LANES] = {0};
+  RB_Scalar kinetic[LANES] = {0};
+  RB_Scalar potential[LANES] = {0};
+  RB_Scalar gravity = rb_global_config.gravity_scale;
+  RB_Scalar spring = rb_global_config.spring_scale;
+  BoneBlock block;
+
+  for (size_t first = 0; first < bones_count; first += LANES) {
+    size_t count = bones_count - first < LANES ? bones_count - first : LANES;
+    gather(&bones[first], count, &block);
+
+    for (size_t i = 0; i < LANES; ++i) {
+      RB_Scalar dx = block.x2[i] - block.x1[i];
+      RB_Scalar dy = block.y2[i] - block.y1[i];
+      RB_Scalar error = rb_abs(rb_sqrt(dx * dx + dy * dy) - block.length[i]);
+      RB_Scalar sx = block.x1[i] - block.px[i];
+      RB_Scalar sy = block.y1[i] - block.py[i];
+      RB_Scalar separation = rb_sqrt(sx * sx + sy * sy);
+
+      // Plain compares rather than rb_max, they map onto SIMD max.
+      max_error[i] = error > max_error[i] ? error : max_error[i];
+      sum_error[i] += error;
+      max_separation[i] =
+          separation > max_separation[i] ? separation : max_separation[i];
+      kinetic[i] += 0.5f * (block.m1[i] * (block.vx1[i] * block.vx1[i] +
+                                           block.vy1[i] * block.vy1[i]) +
+                            block.m2[i] * (block.vx2[i] * block.vx2[i] +
+                                           block.vy2[i] * block.vy2[i]));
+      potential[i] += -gravity * (block.m1[i] * block.y1[i] +
+                                  block.m2[i] * block.y2[i]) +
+                      0.5f * spring * error * error;
+    }
+  }
+
+  memset(diagnostics, 0, sizeof(*diagnostics));
+  for (size_t i = 0; i < LANES; ++i) {
+    diagnostics->max_length_error =
+        rb_max(diagnostics->max_length_error, max_error[i]);
+    diagnostics->mean_length_error += sum_error[i];
+    diagnostics->max_joint_separation =
+        rb_max(diagnostics->max_joint_separation, max_separation[i]);
+    diagnostics->kinetic_energy += kinetic[i];
+    diagnostics->potential_energy += potential[i];
+  }
+  if (bones_count > 0) {
+    diagnostics->mean_length_error /= (RB_Scalar)bones_count;
+  }
+}
@@ -0,0 +1,42 @@
+#include "rigidbodylib.h"
+
+// Bones per range when extracting in parallel, enough that a range
+// streams a few hundred KB of output.
+#define EXTRACT_GRAIN 8192
+
+typedef struct {
+  const RB_Bone *bones;
+  RB_RenderVertex *out;
+} ExtractTask;
+
+// Straight copy with a conversion, no branches, so the stores stream and
+// gcc packs the double to float conversions of DOUBLE builds.
+static void extract_range(void *data, uint32_t begin, uint32_t end)
+{
+  ExtractTask *task = data;
+  const RB_Bone *restrict bones = task->bones;
+  RB_RenderVertex *restrict out = task->out;
+  for (size_t i = begin; i < end; ++i) {
+    out[i * 2].x = (float)bones[i].joint1_pos.x;
+    out[i * 2].y = (float)bones[i].joint1_pos.y;
+    out[i * 2].mass = (float)bones[i].joint1_mass;
+    out[i * 2 + 1].x = (float)bones[i].joint2_pos.x;
+    out[i * 2 + 1].y = (float)bones[i].joint2_pos.y;
+    out[i * 2 + 1].mass = (float)bones[i].joint2_mass;
+  }
+}
+
+void rb_extract_vertices(const RB_Bone *bones, size_t bones_count,
+                         RB_RenderVertex *out)
+{
+  // Ranges are counted in uint32_t, bigger arrays go in slices.
+  while (bones_count > 0) {
+    uint32_t count =
+        bones_count > UINT32_MAX ? UINT32_MAX : (uint32_t)bones_count;
+    ExtractTask task = {bones, out};
+    rb_parallel_for(extract_range, &task, count, EXTRACT_GRAIN);
+    bones += count;
+    out += (size_t)count * 2;
+    bones_count -= count;
+  }
+}
@@ -0,0 +1,83 @@
+#include "rigidbodylib.h"
+#include <string.h>
+
+#define HASH_SEED 0x9e3779b97f4a7c15ull
+#define HASH_K1 0xff51afd7ed558ccdull
+#define HASH_K2 0xc4ceb9fe1a85ec53ull
+
+static uint64_t rotl(uint64_t v, int r)
+{
+  return (v << r) | (v >> (64 - r));
+}
+
+static uint64_t mix(uint64_t hash, uint64_t value)
+{
+  hash ^= value * HASH_K1;
+  return rotl(hash, 31) * HASH_K2;
+}
+
+static uint64_t scalar_bits(RB_Scalar v)
+{
+  if (v != v) {
+    return 0x7ff8000000000000ull; // canonical NaN
+  }
+  if (v == 0) {
+    return 0; // fold -0 into 0
+  }
+
+#ifdef RB_DOUBLE
+  uint64_t bits;
+#else
+  uint32_t bits;
+#endif
+  memcpy(&bits, &v, sizeof(bits));
+  return bits;
+}
+
+static uint64_t mix_vector(uint64_t hash, RB_Vector2 v)
+{
+  hash = mix(hash, scalar_bits(v.x));
+  return mix(hash, scalar_bits(v.y));
+}
+
+uint64_t rb_state_hash_block(const RB_Bone *bones, size_t bones_count,
+                             size_t block)
+{
+  size_t first = block * RB_STATE_HASH_BLOCK;
+  size_t last = first + RB_STATE_HASH_BLOCK;
+  if (last > bones_count) {
+    last = bones_count;
+  }
+
+  uint64_t hash = HASH_SEED ^ block;
+  for (size_t i = first; i < last; ++i) {
+    const RB_Bone *bone = &bones[i];
+    hash = mix_vector(hash, bone->joint1_pos);
+    hash = mix_vector(hash, bone->joint2_pos);
+    hash = mix_vector(hash, bone->joint1_velocity);
+    hash = mix_vector(hash, bone->joint2_velocity);
+  }
+  return hash;
+}
+
+uint64_t rb_state_hash_combine(const uint64_t *block_hashes, size_t blocks)
+{
+  uint64_t hash = HASH_SEED;
+  for (size_t i = 0; i < blocks; ++i) {
+    hash = mix(hash, block_hashes[i]);
+  }
+  return hash ^ (hash >> 29);
+}
+
+uint64_t rb_state_hash(const RB_Bone *bones, size_t bones_count)
+{
+  size_t blocks =
+      (bones_count + RB_STATE_HASH_BLOCK - 1) / RB_STATE_HASH_BLOCK;
+
+  // Same reduction as rb_state_hash_combine, without the block array.
+  uint64_t hash = HASH_SEED;
+  for (size_t i = 0; i < blocks; ++i) {
+    hash = mix(hash, rb_state_hash_block(bones, bones_count, i));
+  }
+  return hash ^ (hash >> 29);
+}
@@ -0,0 +1,271 @@
+#include "rigidbodylib.h"
+#include "rb_math.h"
+#include "rb_profile.h"
+#include <string.h>
+
+// Bones per range when islands step in parallel.
+#define ISLAND_GRAIN 256
+
+int rb_islands_init(RB_Islands *islands, size_t capacity)
+{
+  memset(islands, 0, sizeof(*islands));
+  islands->capacity = capacity;
+  islands->max_substeps = 16;
+  islands->max_stiffness = 0.5f;
+  islands->max_travel = 0.25f;
+  islands->island = malloc(capacity * sizeof(uint32_t));
+  islands->first = malloc((capacity + 1) * sizeof(uint32_t));
+  islands->bones = malloc(capacity * sizeof(uint32_t));
+  islands->level = malloc(capacity * sizeof(uint8_t));
+  islands->batch_bones = malloc(capacity * sizeof(uint32_t));
+  islands->batch_islands = malloc(capacity * sizeof(uint32_t));
+  islands->batch_island_first = malloc((capacity + 1) * sizeof(uint32_t));
+  if (!islands->first || !islands->batch_island_first ||
+      (capacity && (!islands->island || !islands->bones || !islands->level ||
+                    !islands->batch_bones || !islands->batch_islands))) {
+    rb_islands_free(islands);
+    return -1;
+  }
+  islands->first[0] = 0;
+  return 0;
+}
+
+void rb_islands_free(RB_Islands *islands)
+{
+  free(islands->island);
+  free(islands->first);
+  free(islands->bones);
+  free(islands->level);
+  free(islands->batch_bones);
+  free(islands->batch_islands);
+  free(islands->batch_island_first);
+  memset(islands, 0, sizeof(*islands));
+}
+
+static uint32_t find(uint32_t *parent, uint32_t i)
+{
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+// The smaller root wins, so parent[i] <= i holds throughout.
+static void link(uint32_t *parent, const RB_Bone *bones, size_t bones_count,
+                 uint32_t i, const void *other)
+{
+  if (!other) {
+    return;
+  }
+  size_t j = (size_t)((const RB_Bone *)other - bones);
+  if (j >= bones_count) {
+    return;
+  }
+  uint32_t a = find(parent, i);
+  uint32_t b = find(parent, (uint32_t)j);
+  if (a < b) {
+    parent[b] = a;
+  } else {
+    parent[a] = b;
+  }
+}
+
+int rb_islands_build(RB_Islands *islands, const RB_Bone *bones,
+                     size_t bones_count)
+{
+  if (bones_count > islands->capacity) {
+    return -1;
+  }
+
+  uint32_t *island = islands->island;
+  for (size_t i = 0; i < bones_count; ++i) {
+    island[i] = (uint32_t)i;
+  }
+  for (size_t i = 0; i < bones_count; ++i) {
+    link(island, bones, bones_count, (uint32_t)i, bones[i].joint1);
+    link(island, bones, bones_count, (uint32_t)i, bones[i].joint2);
+  }
+
+  // Parents come first, so one forward pass flattens every bone to its
+  // root and numbers the roots in bone order.
+  uint32_t *ids = islands->batch_bones;
+  size_t count = 0;
+  for (size_t i = 0; i < bones_count; ++i) {
+    uint32_t root = island[island[i]];
+    if (root == i) {
+      ids[i] = (uint32_t)count++;
+    }
+    island[i] = root;
+  }
+  for (size_t i = 0; i < bones_count; ++i) {
+    island[i] = ids[island[i]];
+  }
+
+  // Counting sort of the bones by island.
+  uint32_t *first = islands->first;
+  memset(first, 0, (count + 1) * sizeof(uint32_t));
+  for (size_t i = 0; i < bones_count; ++i) {
+    first[island[i] + 1]++;
+  }
+  for (size_t k = 0; k < count; ++k) {
+    first[k + 1] += first[k];
+  }
+  for (size_t i = 0; i < bones_count; ++i) {
+    islands->bones[first[island[i]]++] = (uint32_t)i;
+  }
+  for (size_t k = count; k > 0; --k) {
+    first[k] = first[k - 1];
+  }
+  first[0] = 0;
+
+  islands->bones_count = bones_count;
+  islands->count = count;
+  return 0;
+}
+
+// Squared number of substeps one joint asks for, compared squared to
+// leave a single square root per island.
+static RB_Scalar joint_need(const RB_Islands *islands, RB_Scalar mass,
+                            RB_Vector2 velocity, RB_Scalar length,
+                            RB_Scalar dt2)
+{
+  RB_Scalar need = 0;
+  if (mass != 0) {
+    RB_Scalar stiffness = islands->max_stiffness * islands->max_stiffness;
+    need = dt2 * rb_global_config.spring_scale / (mass * stiffness);
+  }
+  if (length > 0) {
+    RB_Scalar travel = islands->max_travel * length;
+    RB_Scalar speed2 = velocity.x * velocity.x + velocity.y * velocity.y;
+    need = rb_max(need, dt2 * speed2 / (travel * travel));
+  }
+  return need;
+}
+
+static uint8_t island_level(const RB_Islands *islands, const RB_Bone *bones,
+                            size_t k, RB_Scalar dt)
+{
+  RB_Scalar dt2 = dt * dt;
+  RB_Scalar need = 0;
+  for (uint32_t i = islands->first[k]; i < islands->first[k + 1]; ++i) {
+    const RB_Bone *bone = &bones[islands->bones[i]];
+    need = rb_max(need, joint_need(islands, bone->joint1_mass,
+                                   bone->joint1_velocity, bone->length, dt2));
+    need = rb_max(need, joint_need(islands, bone->joint2_mass,
+                                   bone->joint2_velocity, bone->length, dt2));
+  }
+
+  RB_Scalar substeps = rb_sqrt(need);
+  // Also catches NaN, exploded islands get the most substeps.
+  if (!(substeps <= (RB_Scalar)islands->max_substeps)) {
+    substeps = (RB_Scalar)islands->max_substeps;
+  }
+  uint8_t level = 0;
+  while ((RB_Scalar)(1u << level) < substeps &&
+         level < RB_ISLAND_LEVELS - 1) {
+    level++;
+  }
+  return level;
+}
+
+void rb_plan_islands(RB_Islands *islands, const RB_Bone *bones, RB_Scalar dt)
+{
+  uint32_t *batch_first = islands->batch_first;
+  memset(batch_first, 0, sizeof(islands->batch_first));
+  for (size_t k = 0; k < islands->count; ++k) {
+    islands->level[k] = island_level(islands, bones, k, dt);
+    batch_first[islands->level[k] + 1] +=
+        islands->first[k + 1] - islands->first[k];
+  }
+  for (int level = 0; level < RB_ISLAND_LEVELS; ++level) {
+    batch_first[level + 1] += batch_first[level];
+  }
+
+  // Gather the bones of each batch into one list, island by island.
+  uint32_t fill[RB_ISLAND_LEVELS];
+  uint32_t island_count[RB_ISLAND_LEVELS + 1] = {0};
+  for (size_t k = 0; k < islands->count; ++k) {
+    island_count[islands->level[k] + 1]++;
+  }
+  for (int level = 0; level < RB_ISLAND_LEVELS; ++level) {
+    island_count[level + 1] += island_count[level];
+  }
+  memcpy(fill, batch_first, sizeof(fill));
+  for (size_t k = 0; k < islands->count; ++k) {
+    uint32_t size = islands->first[k + 1] - islands->first[k];
+    uint32_t slot = island_count[islands->level[k]]++;
+    islands->batch_islands[slot] = (uint32_t)k;
+    islands->batch_island_first[slot] = fill[islands->level[k]];
+    memcpy(&islands->batch_bones[fill[islands->level[k]]],
+           &islands->bones[islands->first[k]], size * sizeof(uint32_t));
+    fill[islands->level[k]] += size;
+  }
+  islands->batch_island_first[islands->count] = (uint32_t)islands->bones_count;
+}
+
+typedef struct {
+  RB_Islands *islands;
+  RB_Bone *bones;
+  RB_Scalar dt;
+} StepTask;
+
+// First island in batch order starting at or after bone position begin.
+static uint32_t first_island_at(const RB_Islands *islands, uint32_t begin)
+{
+  uint32_t lo = 0;
+  uint32_t hi = (uint32_t)islands->count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (islands->batch_island_first[mid] < begin) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Steps the islands starting in [begin, end) of batch_bones. Neighbouring
+// islands of the same level are stepped as one list.
+static void step_range(void *data, uint32_t begin, uint32_t end)
+{
+  StepTask *task = data;
+  RB_Islands *islands = task->islands;
+  const uint32_t *island_first = islands->batch_island_first;
+
+  uint32_t j = first_island_at(islands, begin);
+  while (j < islands->count && island_first[j] < end) {
+#ifdef RB_ENABLE_TRACE
+    double start = rb_profile_now();
+#endif
+    uint8_t level = islands->level[islands->batch_islands[j]];
+    uint32_t run = j + 1;
+    while (run < islands->count && island_first[run] < end &&
+           islands->level[islands->batch_islands[run]] == level) {
+      run++;
+    }
+
+    uint32_t substeps = 1u << level;
+    RB_Scalar h = task->dt / (RB_Scalar)substeps;
+    for (uint32_t s = 0; s < substeps; ++s) {
+      rb_update_bone_list(task->bones, &islands->batch_bones[island_first[j]],
+                          island_first[run] - island_first[j], h);
+    }
+    RB_TRACE("islands", "substeps", (int64_t)substeps, start,
+             rb_profile_now());
+    j = run;
+  }
+}
+
+void rb_update_islands(RB_Islands *islands, RB_Bone *bones, RB_Scalar dt)
+{
+#ifdef RB_ENABLE_STATS
+  memset(&rb_step_stats, 0, sizeof(rb_step_stats));
+#endif
+  rb_plan_islands(islands, bones, dt);
+
+  StepTask task = {islands, bones, dt};
+  rb_parallel_for(step_range, &task, (uint32_t)islands->bones_count,
+                  ISLAND_GRAIN);
+}
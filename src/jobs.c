@@ -0,0 +1,418 @@
+#include "rigidbodylib.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+static void serial_enqueue(void *context, RB_TaskFn fn, void *data,
+                           uint32_t begin, uint32_t end, uint32_t grain)
+{
+  (void)context;
+  (void)grain;
+  fn(data, begin, end);
+}
+
+static void serial_wait(void *context)
+{
+  (void)context;
+}
+
+RB_JobSystem rb_serial_job_system(void)
+{
+  RB_JobSystem jobs = {0, serial_enqueue, serial_wait};
+  return jobs;
+}
+
+static RB_JobSystem rb_job_system = {0, serial_enqueue, serial_wait};
+
+void rb_set_job_system(const RB_JobSystem *jobs)
+{
+  rb_job_system = jobs ? *jobs : rb_serial_job_system();
+}
+
+RB_JobSystem rb_get_job_system(void)
+{
+  return rb_job_system;
+}
+
+void rb_parallel_for(RB_TaskFn fn, void *data, uint32_t count, uint32_t grain)
+{
+  if (count == 0) {
+    return;
+  }
+  rb_job_system.enqueue(rb_job_system.context, fn, data, 0, count,
+                        grain ? grain : 1);
+  rb_job_system.wait(rb_job_system.context);
+}
+
+// Work-stealing scheduler. Every thread owns a Chase-Lev deque: the owner
+// pushes and pops ranges at the bottom, idle threads steal from the top.
+// A range bigger than its grain is split in halves, the upper half pushed
+// for thieves and the lower half split again, so big ranges spread over
+// the threads while small ones stay with the thread that made them.
+
+#define DEQUE_CAPACITY 1024 // ranges, a power of two
+#define SPINS_BEFORE_YIELD 64
+
+#define GROUP_JOBS 16 // enqueues per wait, more run right away
+#define MAX_DEPTH 8 // nested waits per thread
+#define OUTSIDE_WORKERS 8 // outside threads enqueuing at once, more run inline
+
+// What a thread enqueued since its last wait. A group counts in
+// RB_Scheduler.active while remaining is above 0.
+typedef struct {
+  _Atomic uint32_t remaining; // items not yet run
+  int jobs;
+} Group;
+
+typedef struct {
+  RB_TaskFn fn;
+  void *data;
+  uint32_t grain;
+  Group *group;
+} Job;
+
+// Both words of a range are atomics so a thief racing with the owner
+// reusing a slot reads stale values, not undefined ones. It throws them
+// away when its claim on top fails.
+typedef struct {
+  _Atomic(Job *) job;
+  _Atomic uint64_t range; // begin << 32 | end
+} Slot;
+
+typedef struct {
+  _Atomic int64_t top;
+  char pad[64 - sizeof(int64_t)]; // top and bottom on their own lines
+  _Atomic int64_t bottom;
+  Slot slots[DEQUE_CAPACITY];
+} Deque;
+
+typedef struct {
+  Job *job;
+  uint32_t begin;
+  uint32_t end;
+} Range;
+
+typedef struct {
+  RB_Scheduler *scheduler;
+  Deque deque;
+  pthread_t thread;
+  uint32_t rng;
+  _Atomic int claimed; // outside workers: taken by a thread
+} Worker;
+
+// Groups and their jobs live with the enqueuing thread until its wait
+// returns. A wait opens the next level, so tasks it runs meanwhile can
+// enqueue and wait without mixing up their groups.
+typedef struct {
+  Group groups[MAX_DEPTH];
+  Job jobs[MAX_DEPTH][GROUP_JOBS];
+  int depth;
+  Worker *outside; // current_worker before claiming an outside worker
+} ThreadJobs;
+
+// The first OUTSIDE_WORKERS workers have no thread, threads outside the
+// pool claim them. The pool threads follow.
+struct RB_Scheduler {
+  Worker *workers;
+  int count; // all workers, fixed so thieves can read it without locks
+  int threads; // pool threads that started
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  _Atomic int active; // groups with ranges left to run
+  _Atomic int stop;
+};
+
+static _Thread_local Worker *current_worker;
+static _Thread_local ThreadJobs thread_jobs;
+
+static int push(Deque *deque, Range range)
+{
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+  if (b - t >= DEQUE_CAPACITY) {
+    return 0;
+  }
+  Slot *slot = &deque->slots[b & (DEQUE_CAPACITY - 1)];
+  atomic_store_explicit(&slot->job, range.job, memory_order_relaxed);
+  atomic_store_explicit(&slot->range,
+                        (uint64_t)range.begin << 32 | range.end,
+                        memory_order_relaxed);
+  atomic_store_explicit(&deque->bottom, b + 1, memory_order_release);
+  return 1;
+}
+
+static Range read_slot(Deque *deque, int64_t index)
+{
+  Slot *slot = &deque->slots[index & (DEQUE_CAPACITY - 1)];
+  uint64_t range = atomic_load_explicit(&slot->range, memory_order_relaxed);
+  Range r = {atomic_load_explicit(&slot->job, memory_order_relaxed),
+             (uint32_t)(range >> 32), (uint32_t)range};
+  return r;
+}
+
+// The owner's store to bottom and load of top in pop, and a thief's loads
+// of top and bottom in steal, must not be reordered, or both could take
+// the last range. The published algorithm puts seq_cst fences between
+// them. seq_cst accesses give the same order at about the same cost on
+// x86 and ARM, and unlike fences are understood by ThreadSanitizer.
+static int pop(Deque *deque, Range *range)
+{
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&deque->bottom, b, memory_order_seq_cst);
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_seq_cst);
+
+  if (t > b) {
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    return 0;
+  }
+  *range = read_slot(deque, b);
+  if (t == b) {
+    // Last range, race the thieves for it.
+    int won = atomic_compare_exchange_strong_explicit(
+        &deque->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    return won;
+  }
+  return 1;
+}
+
+static int steal(Deque *deque, Range *range)
+{
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_seq_cst);
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_seq_cst);
+  if (t >= b) {
+    return 0;
+  }
+  *range = read_slot(deque, t);
+  return atomic_compare_exchange_strong_explicit(
+      &deque->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+}
+
+static uint32_t next_random(Worker *worker)
+{
+  uint32_t x = worker->rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return worker->rng = x;
+}
+
+static int find_range(Worker *worker, Range *range)
+{
+  if (pop(&worker->deque, range)) {
+    return 1;
+  }
+  RB_Scheduler *scheduler = worker->scheduler;
+  int start = (int)(next_random(worker) % (uint32_t)scheduler->count);
+  for (int i = 0; i < scheduler->count; ++i) {
+    Worker *victim = &scheduler->workers[(start + i) % scheduler->count];
+    if (victim != worker && steal(&victim->deque, range)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void run_range(Worker *worker, Range range)
+{
+  Job *job = range.job;
+  while (range.end - range.begin > job->grain) {
+    uint32_t middle = range.begin + (range.end - range.begin) / 2;
+    Range upper = {job, middle, range.end};
+    if (!push(&worker->deque, upper)) {
+      break; // deque full, run the rest here
+    }
+    range.end = middle;
+  }
+
+  job->fn(job->data, range.begin, range.end);
+  uint32_t count = range.end - range.begin;
+  if (atomic_fetch_sub_explicit(&job->group->remaining, count,
+                                memory_order_release) == count) {
+    // The group is done, let idle workers go to sleep even if its owner
+    // has not waited yet.
+    atomic_fetch_sub(&worker->scheduler->active, 1);
+  }
+}
+
+static void *worker_main(void *arg)
+{
+  Worker *worker = arg;
+  RB_Scheduler *scheduler = worker->scheduler;
+  current_worker = worker;
+
+  int idle = 0;
+  while (!atomic_load(&scheduler->stop)) {
+    Range range;
+    if (find_range(worker, &range)) {
+      run_range(worker, range);
+      idle = 0;
+    } else if (atomic_load(&scheduler->active) > 0) {
+      if (++idle > SPINS_BEFORE_YIELD) {
+        sched_yield();
+      }
+    } else {
+      pthread_mutex_lock(&scheduler->lock);
+      while (atomic_load(&scheduler->active) == 0 &&
+             !atomic_load(&scheduler->stop)) {
+        pthread_cond_wait(&scheduler->wake, &scheduler->lock);
+      }
+      pthread_mutex_unlock(&scheduler->lock);
+    }
+  }
+  return 0;
+}
+
+// A thread outside the pool claims an outside worker from its first
+// enqueue until its outermost wait returns, so it never waits for another
+// outside thread. Its deque stays stealable after it is released. Returns
+// null when all are taken.
+static Worker *enter(RB_Scheduler *scheduler)
+{
+  Worker *worker = current_worker;
+  if (worker && worker->scheduler == scheduler) {
+    return worker;
+  }
+  for (int i = 0; i < OUTSIDE_WORKERS; ++i) {
+    Worker *outside = &scheduler->workers[i];
+    int expected = 0;
+    if (atomic_compare_exchange_strong_explicit(
+            &outside->claimed, &expected, 1, memory_order_acquire,
+            memory_order_relaxed)) {
+      thread_jobs.outside = worker;
+      current_worker = outside;
+      return outside;
+    }
+  }
+  return 0;
+}
+
+static void scheduler_enqueue(void *context, RB_TaskFn fn, void *data,
+                              uint32_t begin, uint32_t end, uint32_t grain)
+{
+  RB_Scheduler *scheduler = context;
+  ThreadJobs *tj = &thread_jobs;
+  Group *group = &tj->groups[tj->depth];
+  if (begin >= end) {
+    return;
+  }
+  Worker *worker = 0;
+  if (tj->depth == MAX_DEPTH - 1 || group->jobs == GROUP_JOBS ||
+      !(worker = enter(scheduler))) {
+    fn(data, begin, end);
+    return;
+  }
+
+  Job *job = &tj->jobs[tj->depth][group->jobs++];
+  job->fn = fn;
+  job->data = data;
+  job->grain = grain ? grain : 1;
+  job->group = group;
+  // Pairs with the decrement in run_range when remaining drops back to 0.
+  if (atomic_fetch_add_explicit(&group->remaining, end - begin,
+                                memory_order_relaxed) == 0 &&
+      atomic_fetch_add(&scheduler->active, 1) == 0) {
+    pthread_mutex_lock(&scheduler->lock);
+    pthread_cond_broadcast(&scheduler->wake);
+    pthread_mutex_unlock(&scheduler->lock);
+  }
+
+  Range range = {job, begin, end};
+  if (!push(&worker->deque, range)) {
+    run_range(worker, range);
+  }
+}
+
+static void scheduler_wait(void *context)
+{
+  RB_Scheduler *scheduler = context;
+  ThreadJobs *tj = &thread_jobs;
+  Group *group = &tj->groups[tj->depth];
+  if (group->jobs == 0) {
+    return;
+  }
+
+  // Help with anything while waiting, ranges of other groups included.
+  Worker *worker = current_worker;
+  tj->depth++;
+  int idle = 0;
+  Range range;
+  while (atomic_load_explicit(&group->remaining, memory_order_acquire) > 0) {
+    if (find_range(worker, &range)) {
+      run_range(worker, range);
+      idle = 0;
+    } else if (++idle > SPINS_BEFORE_YIELD) {
+      sched_yield();
+    }
+  }
+  tj->depth--;
+
+  group->jobs = 0;
+  if (tj->depth == 0 && worker < scheduler->workers + OUTSIDE_WORKERS) {
+    current_worker = tj->outside;
+    atomic_store_explicit(&worker->claimed, 0, memory_order_release);
+  }
+}
+
+RB_Scheduler *rb_scheduler_create(int threads)
+{
+  if (threads <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (int)cpus : 1;
+  }
+
+  int count = OUTSIDE_WORKERS + threads - 1;
+  RB_Scheduler *scheduler = calloc(1, sizeof(RB_Scheduler));
+  Worker *workers = calloc((size_t)count, sizeof(Worker));
+  if (!scheduler || !workers) {
+    free(scheduler);
+    free(workers);
+    return 0;
+  }
+  scheduler->workers = workers;
+  scheduler->count = count;
+  pthread_mutex_init(&scheduler->lock, 0);
+  pthread_cond_init(&scheduler->wake, 0);
+
+  for (int i = 0; i < count; ++i) {
+    workers[i].scheduler = scheduler;
+    workers[i].rng = 0x9e3779b9u * (uint32_t)(i + 1);
+  }
+  // A worker whose thread does not start keeps an empty deque, so count
+  // stays as it is and thieves just find nothing there.
+  for (int i = 0; i < threads - 1; ++i) {
+    Worker *worker = &workers[OUTSIDE_WORKERS + i];
+    if (pthread_create(&worker->thread, 0, worker_main, worker) != 0) {
+      break; // run with the threads that did start
+    }
+    scheduler->threads++;
+  }
+  return scheduler;
+}
+
+void rb_scheduler_destroy(RB_Scheduler *scheduler)
+{
+  if (!scheduler) {
+    return;
+  }
+  pthread_mutex_lock(&scheduler->lock);
+  atomic_store(&scheduler->stop, 1);
+  pthread_cond_broadcast(&scheduler->wake);
+  pthread_mutex_unlock(&scheduler->lock);
+  for (int i = 0; i < scheduler->threads; ++i) {
+    pthread_join(scheduler->workers[OUTSIDE_WORKERS + i].thread, 0);
+  }
+
+  pthread_cond_destroy(&scheduler->wake);
+  pthread_mutex_destroy(&scheduler->lock);
+  free(scheduler->workers);
+  free(scheduler);
+}
+
+RB_JobSystem rb_scheduler_job_system(RB_Scheduler *scheduler)
+{
+  RB_JobSystem jobs = {scheduler, scheduler_enqueue, scheduler_wait};
+  return jobs;
+}
@@ -0,0 +1,245 @@
+#include "rigidbodylib.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Preferred mapping address. Chosen far away from where heaps and shared
+// libraries usually land, so the first mapping of a file normally gets it.
+#if UINTPTR_MAX > 0xffffffffu
+#define MAPPED_SNAPSHOT_BASE 0x100000000000ull
+#else
+#define MAPPED_SNAPSHOT_BASE 0x40000000ull
+#endif
+
+#define BONES_OFFSET 128
+#define SAVE_CHUNK 4096
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+static uint64_t checksum_bytes(uint64_t hash, const void *data, size_t size)
+{
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static uint32_t header_checksum(const RB_MappedSnapshotHeader *header)
+{
+  uint64_t hash = checksum_bytes(FNV_OFFSET, header,
+                                 offsetof(RB_MappedSnapshotHeader,
+                                          header_checksum));
+  return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static int64_t link_index(const void *link, const RB_Bone *bones,
+                          size_t bones_count)
+{
+  if (!link) {
+    return -1;
+  }
+
+  uintptr_t offset = (uintptr_t)link - (uintptr_t)bones;
+  if ((uintptr_t)link < (uintptr_t)bones ||
+      offset >= bones_count * sizeof(RB_Bone) || offset % sizeof(RB_Bone)) {
+    return -2;
+  }
+  return (int64_t)(offset / sizeof(RB_Bone));
+}
+
+// Payload checksum covers the bone state and topology by index, so it does
+// not change when links are relocated.
+static uint64_t checksum_bone(uint64_t hash, const RB_Bone *bone,
+                              const RB_Bone *bones, size_t bones_count)
+{
+  int64_t links[2] = {
+      link_index(bone->joint1, bones, bones_count),
+      link_index(bone->joint2, bones, bones_count),
+  };
+  hash = checksum_bytes(hash, links, sizeof(links));
+  return checksum_bytes(hash, (const unsigned char *)bone + RB_BONE_STATE_OFFSET,
+                        RB_BONE_STATE_SIZE);
+}
+
+int rb_mapped_snapshot_save(const char *path, const RB_Bone *bones,
+                            size_t bones_count)
+{
+  _Static_assert(BONES_OFFSET >= sizeof(RB_MappedSnapshotHeader),
+                 "header does not fit before the bones");
+  _Static_assert(BONES_OFFSET % _Alignof(RB_Bone) == 0,
+                 "bones are misaligned");
+
+  RB_MappedSnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = RB_MAPPED_SNAPSHOT_MAGIC;
+  header.version = RB_MAPPED_SNAPSHOT_VERSION;
+  header.bone_size = sizeof(RB_Bone);
+  header.pointer_size = sizeof(void *);
+  header.bones_count = bones_count;
+  header.bones_offset = BONES_OFFSET;
+  header.base_address = MAPPED_SNAPSHOT_BASE + BONES_OFFSET;
+  header.payload_checksum = FNV_OFFSET;
+  header.config = rb_global_config;
+
+  for (size_t i = 0; i < bones_count; ++i) {
+    if (link_index(bones[i].joint1, bones, bones_count) < -1 ||
+        link_index(bones[i].joint2, bones, bones_count) < -1) {
+      return -1;
+    }
+    header.payload_checksum =
+        checksum_bone(header.payload_checksum, &bones[i], bones, bones_count);
+  }
+  header.header_checksum = header_checksum(&header);
+
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    return -1;
+  }
+
+  unsigned char padding[BONES_OFFSET];
+  memset(padding, 0, sizeof(padding));
+  memcpy(padding, &header, sizeof(header));
+  int ok = fwrite(padding, 1, BONES_OFFSET, file) == BONES_OFFSET;
+
+  RB_Bone *chunk = malloc(SAVE_CHUNK * sizeof(RB_Bone));
+  ok = ok && chunk;
+
+  uintptr_t base = (uintptr_t)header.base_address;
+  for (size_t first = 0; ok && first < bones_count; first += SAVE_CHUNK) {
+    size_t count = bones_count - first;
+    if (count > SAVE_CHUNK) {
+      count = SAVE_CHUNK;
+    }
+
+    memcpy(chunk, &bones[first], count * sizeof(RB_Bone));
+    for (size_t i = 0; i < count; ++i) {
+      int64_t joint1 = link_index(chunk[i].joint1, bones, bones_count);
+      int64_t joint2 = link_index(chunk[i].joint2, bones, bones_count);
+      chunk[i].joint1 =
+          joint1 < 0 ? 0 : (void *)(base + joint1 * sizeof(RB_Bone));
+      chunk[i].joint2 =
+          joint2 < 0 ? 0 : (void *)(base + joint2 * sizeof(RB_Bone));
+    }
+    ok = fwrite(chunk, sizeof(RB_Bone), count, file) == count;
+  }
+
+  free(chunk);
+  if (fclose(file) != 0) {
+    ok = 0;
+  }
+  return ok ? 0 : -1;
+}
+
+// Checks every link against the array saved at base and points it into
+// bones instead.
+static int relocate(RB_Bone *bones, size_t bones_count, uintptr_t base)
+{
+  uintptr_t end = base + bones_count * sizeof(RB_Bone);
+
+  for (size_t i = 0; i < bones_count; ++i) {
+    void **links[2] = {&bones[i].joint1, &bones[i].joint2};
+    for (int j = 0; j < 2; ++j) {
+      uintptr_t link = (uintptr_t)*links[j];
+      if (!link) {
+        continue;
+      }
+      if (link < base || link >= end || (link - base) % sizeof(RB_Bone)) {
+        return -1;
+      }
+      *links[j] = &bones[(link - base) / sizeof(RB_Bone)];
+    }
+  }
+  return 0;
+}
+
+int rb_mapped_snapshot_open(const char *path, RB_MappedSnapshot *snapshot)
+{
+  memset(snapshot, 0, sizeof(*snapshot));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < BONES_OFFSET) {
+    close(fd);
+    return -1;
+  }
+
+  RB_MappedSnapshotHeader header;
+  if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+      header.magic != RB_MAPPED_SNAPSHOT_MAGIC ||
+      header.version != RB_MAPPED_SNAPSHOT_VERSION ||
+      header.header_checksum != header_checksum(&header) ||
+      header.bone_size != sizeof(RB_Bone) ||
+      header.pointer_size != sizeof(void *) ||
+      header.bones_offset % _Alignof(RB_Bone) != 0 ||
+      header.bones_count > (SIZE_MAX - header.bones_offset) / sizeof(RB_Bone) ||
+      (uint64_t)st.st_size <
+          header.bones_offset + header.bones_count * sizeof(RB_Bone)) {
+    close(fd);
+    return -1;
+  }
+
+  // Ask for the address the links were written for. There the bones are
+  // used as mapped and no page is touched here. The hint is only a hint:
+  // anywhere else works too, at the cost of one relocation pass.
+  size_t size = (size_t)st.st_size;
+  void *hint = (void *)(uintptr_t)(header.base_address - header.bones_offset);
+  void *mapping =
+      mmap(hint, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return -1;
+  }
+
+  RB_Bone *bones = (RB_Bone *)((unsigned char *)mapping + header.bones_offset);
+  if (mapping != hint) {
+    if (relocate(bones, header.bones_count,
+                 (uintptr_t)header.base_address) != 0) {
+      munmap(mapping, size);
+      return -1;
+    }
+    snapshot->relocated = 1;
+  }
+
+  rb_global_config = header.config;
+  snapshot->bones = bones;
+  snapshot->bones_count = header.bones_count;
+  snapshot->mapping = mapping;
+  snapshot->mapping_size = size;
+  return 0;
+}
+
+void rb_mapped_snapshot_close(RB_MappedSnapshot *snapshot)
+{
+  if (snapshot->mapping) {
+    munmap(snapshot->mapping, snapshot->mapping_size);
+  }
+  memset(snapshot, 0, sizeof(*snapshot));
+}
+
+int rb_mapped_snapshot_verify(const RB_MappedSnapshot *snapshot)
+{
+  const RB_MappedSnapshotHeader *header =
+      (const RB_MappedSnapshotHeader *)snapshot->mapping;
+
+  const RB_Bone *bones = snapshot->bones;
+  size_t bones_count = snapshot->bones_count;
+
+  uint64_t hash = FNV_OFFSET;
+  for (size_t i = 0; i < bones_count; ++i) {
+    if (link_index(bones[i].joint1, bones, bones_count) < -1 ||
+        link_index(bones[i].joint2, bones, bones_count) < -1) {
+      return -1;
+    }
+    hash = checksum_bone(hash, &bones[i], bones, bones_count);
+  }
+  return hash == header->payload_checksum ? 0 : -1;
+}
@@ -0,0 +1,232 @@
+#include "rigidbodylib.h"
+#include "rb_math.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RAY_PACKET_SIZE 8
+#define QUERY_STACK_SIZE 256
+
+// Rays stored lane-wise so every per-ray loop below is a plain loop over
+// RAY_PACKET_SIZE floats that the compiler turns into SIMD.
+typedef struct {
+  RB_Scalar ox[RAY_PACKET_SIZE];
+  RB_Scalar oy[RAY_PACKET_SIZE];
+  RB_Scalar dx[RAY_PACKET_SIZE];
+  RB_Scalar dy[RAY_PACKET_SIZE];
+  RB_Scalar inv_dx[RAY_PACKET_SIZE]; // 0 where the ray is parallel to x
+  RB_Scalar inv_dy[RAY_PACKET_SIZE];
+  RB_Scalar t[RAY_PACKET_SIZE];
+  uint32_t bone[RAY_PACKET_SIZE];
+} RayPacket;
+
+static void packet_load(RayPacket *packet, const RB_Ray *rays, size_t count)
+{
+  for (size_t i = 0; i < RAY_PACKET_SIZE; ++i) {
+    if (i < count) {
+      packet->ox[i] = rays[i].origin.x;
+      packet->oy[i] = rays[i].origin.y;
+      packet->dx[i] = rays[i].direction.x;
+      packet->dy[i] = rays[i].direction.y;
+      packet->t[i] = rays[i].max_t;
+    } else {
+      // Unused lanes can never accept a hit.
+      packet->ox[i] = packet->oy[i] = 0;
+      packet->dx[i] = packet->dy[i] = 0;
+      packet->t[i] = -1;
+    }
+    // Zero (or denormal) components would give 0 * inf = NaN for origins
+    // on a slab plane; packet_hits_aabb handles those lanes separately.
+    RB_Scalar inv_dx = 1.0f / packet->dx[i];
+    RB_Scalar inv_dy = 1.0f / packet->dy[i];
+    packet->inv_dx[i] = rb_abs(inv_dx) <= RB_SCALAR_MAX ? inv_dx : 0;
+    packet->inv_dy[i] = rb_abs(inv_dy) <= RB_SCALAR_MAX ? inv_dy : 0;
+    packet->bone[i] = RB_NO_HIT;
+  }
+}
+
+// Entry and exit t of one slab. A ray parallel to it is inside for all t
+// or for none, depending on where the origin is.
+static inline void slab(RB_Scalar min, RB_Scalar max, RB_Scalar origin,
+                        RB_Scalar inv, RB_Scalar *enter, RB_Scalar *exit)
+{
+  RB_Scalar t1 = (min - origin) * inv;
+  RB_Scalar t2 = (max - origin) * inv;
+  RB_Scalar inside = (origin >= min) & (origin <= max) ? RB_SCALAR_MAX
+                                                       : -RB_SCALAR_MAX;
+  *enter = inv != 0 ? rb_min(t1, t2) : -inside;
+  *exit = inv != 0 ? rb_max(t1, t2) : inside;
+}
+
+static int packet_hits_aabb(const RayPacket *packet, const RB_AABB *aabb)
+{
+  int any = 0;
+  for (size_t i = 0; i < RAY_PACKET_SIZE; ++i) {
+    RB_Scalar tx1, tx2, ty1, ty2;
+    slab(aabb->min.x, aabb->max.x, packet->ox[i], packet->inv_dx[i], &tx1,
+         &tx2);
+    slab(aabb->min.y, aabb->max.y, packet->oy[i], packet->inv_dy[i], &ty1,
+         &ty2);
+
+    RB_Scalar tmin = rb_max(tx1, ty1);
+    RB_Scalar tmax = rb_min(tx2, ty2);
+    RB_Scalar tnear = rb_max(tmin, 0);
+    any |= (tnear <= tmax) & (tnear <= packet->t[i]);
+  }
+  return any;
+}
+
+static void packet_test_bone(RayPacket *packet, const RB_Bone *bone,
+                             uint32_t index)
+{
+  RB_Scalar ax = bone->joint1_pos.x;
+  RB_Scalar ay = bone->joint1_pos.y;
+  RB_Scalar ex = bone->joint2_pos.x - ax;
+  RB_Scalar ey = bone->joint2_pos.y - ay;
+
+  for (size_t i = 0; i < RAY_PACKET_SIZE; ++i) {
+    // Solve origin + t * d = a + s * e. Parallel rays divide by zero and
+    // produce inf/nan, which fail the comparisons below.
+    RB_Scalar denom = packet->dx[i] * ey - packet->dy[i] * ex;
+    RB_Scalar wx = ax - packet->ox[i];
+    RB_Scalar wy = ay - packet->oy[i];
+    RB_Scalar t = (wx * ey - wy * ex) / denom;
+    RB_Scalar s = (wx * packet->dy[i] - wy * packet->dx[i]) / denom;
+
+    int hit = (t >= 0) & (t < packet->t[i]) & (s >= 0) & (s <= 1);
+    packet->t[i] = hit ? t : packet->t[i];
+    packet->bone[i] = hit ? index : packet->bone[i];
+  }
+}
+
+static void packet_cast(RayPacket *packet, const RB_Bone *bones,
+                        size_t bones_count, const RB_AABBTree *tree)
+{
+  if (!tree) {
+    for (size_t i = 0; i < bones_count; ++i) {
+      packet_test_bone(packet, &bones[i], (uint32_t)i);
+    }
+    return;
+  }
+
+  int fixed[QUERY_STACK_SIZE];
+  int *stack = fixed;
+  int capacity = QUERY_STACK_SIZE;
+  int top = 0;
+  if (tree->root == RB_NULL_NODE) {
+    return;
+  }
+  stack[top++] = tree->root;
+
+  while (top > 0) {
+    const RB_AABBTreeNode *node = &tree->nodes[stack[--top]];
+    if (!packet_hits_aabb(packet, &node->aabb)) {
+      continue;
+    }
+
+    if (node->height == 0) {
+      if (node->kind == RB_PROXY_BONE &&
+          (size_t)node->user_index < bones_count) {
+        packet_test_bone(packet, &bones[node->user_index],
+                         (uint32_t)node->user_index);
+      }
+      continue;
+    }
+
+    if (top + 2 > capacity) {
+      int *grown = malloc((size_t)capacity * 2 * sizeof(int));
+      if (!grown) {
+        // Fall back to testing every bone rather than missing hits.
+        for (size_t i = 0; i < bones_count; ++i) {
+          packet_test_bone(packet, &bones[i], (uint32_t)i);
+        }
+        break;
+      }
+      memcpy(grown, stack, (size_t)top * sizeof(int));
+      if (stack != fixed) {
+        free(stack);
+      }
+      stack = grown;
+      capacity *= 2;
+    }
+    stack[top++] = node->child1;
+    stack[top++] = node->child2;
+  }
+
+  if (stack != fixed) {
+    free(stack);
+  }
+}
+
+static int fill_hit(const RayPacket *packet, size_t lane, const RB_Bone *bones,
+                    RB_RayHit *hit)
+{
+  hit->bone = packet->bone[lane];
+  hit->t = packet->t[lane];
+  if (hit->bone == RB_NO_HIT) {
+    return 0;
+  }
+
+  RB_Scalar dx = packet->dx[lane];
+  RB_Scalar dy = packet->dy[lane];
+  hit->point.x = packet->ox[lane] + dx * hit->t;
+  hit->point.y = packet->oy[lane] + dy * hit->t;
+
+  const RB_Bone *bone = &bones[hit->bone];
+  RB_Scalar nx = -(bone->joint2_pos.y - bone->joint1_pos.y);
+  RB_Scalar ny = bone->joint2_pos.x - bone->joint1_pos.x;
+  RB_Scalar length = rb_sqrt(nx * nx + ny * ny);
+  if (length > 0) {
+    nx /= length;
+    ny /= length;
+  }
+  if (nx * dx + ny * dy > 0) {
+    nx = -nx;
+    ny = -ny;
+  }
+  hit->normal.x = nx;
+  hit->normal.y = ny;
+  return 1;
+}
+
+int rb_raycast(const RB_Bone *bones, size_t bones_count,
+               const RB_AABBTree *tree, RB_Vector2 origin,
+               RB_Vector2 direction, RB_Scalar max_t, RB_RayHit *hit)
+{
+  RB_Ray ray = {origin, direction, max_t};
+  RayPacket packet;
+
+  packet_load(&packet, &ray, 1);
+  packet_cast(&packet, bones, bones_count, tree);
+  return fill_hit(&packet, 0, bones, hit);
+}
+
+int rb_segment_cast(const RB_Bone *bones, size_t bones_count,
+                    const RB_AABBTree *tree, RB_Vector2 p1, RB_Vector2 p2,
+                    RB_RayHit *hit)
+{
+  RB_Vector2 direction = {p2.x - p1.x, p2.y - p1.y};
+  return rb_raycast(bones, bones_count, tree, p1, direction, 1.0f, hit);
+}
+
+size_t rb_raycast_batch(const RB_Bone *bones, size_t bones_count,
+                        const RB_AABBTree *tree, const RB_Ray *rays,
+                        size_t ray_count, RB_RayHit *hits)
+{
+  size_t hit_count = 0;
+  RayPacket packet;
+
+  for (size_t first = 0; first < ray_count; first += RAY_PACKET_SIZE) {
+    size_t lanes = ray_count - first;
+    if (lanes > RAY_PACKET_SIZE) {
+      lanes = RAY_PACKET_SIZE;
+    }
+
+    packet_load(&packet, &rays[first], lanes);
+    packet_cast(&packet, bones, bones_count, tree);
+    for (size_t i = 0; i < lanes; ++i) {
+      hit_count += fill_hit(&packet, i, bones, &hits[first + i]);
+    }
+  }
+
+  return hit_count;
+}
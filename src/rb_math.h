@@ -0,0 +1,30 @@
+#ifndef RB_MATH_H
+#define RB_MATH_H
+
+#include <float.h>
+#include <math.h>
+
+// Math functions matching RB_Scalar.
+#ifdef RB_DOUBLE
+#define RB_SCALAR_MAX DBL_MAX
+#define rb_sqrt sqrt
+#define rb_min fmin
+#define rb_max fmax
+#define rb_abs fabs
+#define rb_floor floor
+#define rb_atan2 atan2
+#define rb_cos cos
+#define rb_sin sin
+#else
+#define RB_SCALAR_MAX FLT_MAX
+#define rb_sqrt sqrtf
+#define rb_min fminf
+#define rb_max fmaxf
+#define rb_abs fabsf
+#define rb_floor floorf
+#define rb_atan2 atan2f
+#define rb_cos cosf
+#define rb_sin sinf
+#endif
+
+#endif // RB_MATH_H
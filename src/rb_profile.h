@@ -0,0 +1,34 @@
+#ifndef RB_PROFILE_H
+#define RB_PROFILE_H
+
+#include "rigidbodylib.h"
+
+// Timing helpers shared by step statistics (RB_ENABLE_STATS) and tracing
+// (RB_ENABLE_TRACE). Everything compiles to nothing without either flag.
+#if defined(RB_ENABLE_STATS) || defined(RB_ENABLE_TRACE)
+#include <time.h>
+#define RB_PROFILE 1
+
+static inline double rb_profile_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+#endif
+
+#ifdef RB_ENABLE_STATS
+#define RB_STATS_ADD(phase, seconds)                                          \
+  (rb_step_stats.phase_seconds[phase] += (seconds))
+#else
+#define RB_STATS_ADD(phase, seconds) ((void)0)
+#endif
+
+#ifdef RB_ENABLE_TRACE
+#define RB_TRACE(name, arg_name, arg, start, end)                             \
+  rb_trace_event(name, arg_name, arg, start, end)
+#else
+#define RB_TRACE(name, arg_name, arg, start, end) ((void)0)
+#endif
+
+#endif // RB_PROFILE_H
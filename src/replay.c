@@ -0,0 +1,160 @@
+#include "rigidbodylib.h"
+#include <string.h>
+
+enum {
+  TAG_IMPULSE = 1,
+  TAG_STEP = 2,
+  TAG_STEP_SAME_DT = 3, // dt equal to the previous step
+};
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t flags;
+  uint32_t scalar_size;
+  uint64_t snapshot_size;
+} ReplayHeader;
+
+static int write_bytes(FILE *file, const void *data, size_t size)
+{
+  return fwrite(data, 1, size, file) == size;
+}
+
+static int read_bytes(FILE *file, void *data, size_t size)
+{
+  return fread(data, 1, size, file) == size;
+}
+
+int rb_recorder_begin(RB_Recorder *recorder, FILE *file, const RB_Bone *bones,
+                      size_t bones_count, int flags)
+{
+  memset(recorder, 0, sizeof(*recorder));
+  recorder->file = file;
+  recorder->flags = flags;
+  recorder->last_dt = -1;
+
+  size_t size = rb_snapshot_size(bones_count);
+  void *snapshot = malloc(size);
+  if (!snapshot || !rb_snapshot_save(bones, bones_count, snapshot, size)) {
+    free(snapshot);
+    return -1;
+  }
+
+  ReplayHeader header = {
+      RB_REPLAY_MAGIC, RB_REPLAY_VERSION, (uint32_t)flags,
+      sizeof(RB_Scalar), size,
+  };
+  int ok = write_bytes(file, &header, sizeof(header)) &&
+           write_bytes(file, snapshot, size);
+  free(snapshot);
+  return ok ? 0 : -1;
+}
+
+void rb_recorder_apply_impulse(RB_Recorder *recorder, RB_Bone *bones,
+                               uint32_t bone, int joint, RB_Vector2 impulse)
+{
+  uint8_t tag = TAG_IMPULSE;
+  uint8_t joint_index = (uint8_t)joint;
+
+  write_bytes(recorder->file, &tag, sizeof(tag));
+  write_bytes(recorder->file, &bone, sizeof(bone));
+  write_bytes(recorder->file, &joint_index, sizeof(joint_index));
+  write_bytes(recorder->file, &impulse.x, sizeof(impulse.x));
+  write_bytes(recorder->file, &impulse.y, sizeof(impulse.y));
+
+  rb_apply_impulse(&bones[bone], joint, impulse);
+}
+
+void rb_recorder_step(RB_Recorder *recorder, RB_Bone *bones,
+                      size_t bones_count, RB_Scalar dt)
+{
+  rb_update_bones(bones, bones_count, dt);
+
+  uint8_t tag = dt == recorder->last_dt ? TAG_STEP_SAME_DT : TAG_STEP;
+  write_bytes(recorder->file, &tag, sizeof(tag));
+  if (tag == TAG_STEP) {
+    write_bytes(recorder->file, &dt, sizeof(dt));
+    recorder->last_dt = dt;
+  }
+
+  if (recorder->flags & RB_REPLAY_HASHES) {
+    uint64_t hash = rb_state_hash(bones, bones_count);
+    write_bytes(recorder->file, &hash, sizeof(hash));
+  }
+  recorder->frames++;
+}
+
+int rb_recorder_end(RB_Recorder *recorder)
+{
+  return fflush(recorder->file) == 0 && !ferror(recorder->file) ? 0 : -1;
+}
+
+int rb_replay_run(FILE *file, RB_Bone *bones, size_t capacity,
+                  size_t *bones_count, uint64_t stop_frame,
+                  RB_ReplayResult *result)
+{
+  result->frames = 0;
+  result->first_divergent_frame = UINT64_MAX;
+
+  ReplayHeader header;
+  if (!read_bytes(file, &header, sizeof(header)) ||
+      header.magic != RB_REPLAY_MAGIC ||
+      header.version != RB_REPLAY_VERSION ||
+      header.scalar_size != sizeof(RB_Scalar) ||
+      header.snapshot_size > SIZE_MAX) {
+    return -1;
+  }
+
+  void *snapshot = malloc((size_t)header.snapshot_size);
+  int ok = snapshot && read_bytes(file, snapshot, header.snapshot_size) &&
+           rb_snapshot_load(snapshot, header.snapshot_size, bones, capacity,
+                            bones_count) == 0;
+  free(snapshot);
+  if (!ok) {
+    return -1;
+  }
+
+  RB_Scalar dt = 0;
+  uint8_t tag;
+  while (result->frames < stop_frame && read_bytes(file, &tag, sizeof(tag))) {
+    switch (tag) {
+    case TAG_IMPULSE: {
+      uint32_t bone;
+      uint8_t joint;
+      RB_Vector2 impulse;
+      if (!read_bytes(file, &bone, sizeof(bone)) ||
+          !read_bytes(file, &joint, sizeof(joint)) ||
+          !read_bytes(file, &impulse.x, sizeof(impulse.x)) ||
+          !read_bytes(file, &impulse.y, sizeof(impulse.y)) ||
+          bone >= *bones_count) {
+        return -1;
+      }
+      rb_apply_impulse(&bones[bone], joint, impulse);
+      break;
+    }
+    case TAG_STEP:
+      if (!read_bytes(file, &dt, sizeof(dt))) {
+        return -1;
+      }
+      // fallthrough
+    case TAG_STEP_SAME_DT:
+      rb_update_bones(bones, *bones_count, dt);
+      if (header.flags & RB_REPLAY_HASHES) {
+        uint64_t expected;
+        if (!read_bytes(file, &expected, sizeof(expected))) {
+          return -1;
+        }
+        if (result->first_divergent_frame == UINT64_MAX &&
+            rb_state_hash(bones, *bones_count) != expected) {
+          result->first_divergent_frame = result->frames;
+        }
+      }
+      result->frames++;
+      break;
+    default:
+      return -1;
+    }
+  }
+
+  return 0;
+}
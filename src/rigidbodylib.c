@@ -1,8 +1,47 @@
 #include "rigidbodylib.h"
-#include <math.h>
+#include "rb_math.h"
+#include "rb_profile.h"
 #include <stdio.h>
+#include <string.h>
 
 RB_Config rb_global_config;
+_Thread_local RB_StepStats rb_step_stats;
+
+#ifdef RB_ENABLE_TRACE
+static const char *phase_names[RB_PHASE_COUNT] = {
+    "forces", "joints", "gravity", "integrate", "collision",
+};
+#endif
+
+#ifdef RB_PROFILE
+// Bones are stepped one after another, so phases interleave bone by bone.
+// Each call adds to a per phase total, reported once at the end of the
+// step. Trace events lay the totals back to back from the step start.
+#define PHASE_BEGIN()                                                         \
+  double phase_seconds[RB_PHASE_COUNT] = {0};                                \
+  double phase_start = rb_profile_now();                                     \
+  double phase_time = phase_start
+#define PHASE_END(phase)                                                      \
+  do {                                                                       \
+    double phase_end = rb_profile_now();                                     \
+    phase_seconds[phase] += phase_end - phase_time;                          \
+    phase_time = phase_end;                                                  \
+  } while (0)
+#define PHASE_REPORT() report_phases(phase_seconds, phase_start)
+
+static void report_phases(const double *seconds, double start)
+{
+  for (int phase = 0; phase < RB_PHASE_COUNT; ++phase) {
+    RB_STATS_ADD(phase, seconds[phase]);
+    RB_TRACE(phase_names[phase], 0, 0, start, start + seconds[phase]);
+    start += seconds[phase];
+  }
+}
+#else
+#define PHASE_BEGIN()
+#define PHASE_END(phase)
+#define PHASE_REPORT()
+#endif
 
 void rb_init_config(const RB_Config *config)
 {
@@ -15,38 +54,51 @@ void rb_init_config(const RB_Config *config)
   }
 }
 
-float rb_calculate_distance(RB_Vector2 *v1, RB_Vector2 *v2)
+RB_Scalar rb_calculate_distance(RB_Vector2 *v1, RB_Vector2 *v2)
 {
-  float dx = v2->x - v1->x;
-  float dy = v2->y - v1->y;
-  return sqrtf(dx * dx + dy * dy);
+  RB_Scalar dx = v2->x - v1->x;
+  RB_Scalar dy = v2->y - v1->y;
+  return rb_sqrt(dx * dx + dy * dy);
 };
 
 void rb_calculate_object_resistance_force(RB_Bone *bone)
 {
-  float dx = bone->joint2_pos.x - bone->joint1_pos.x;
-  float dy = bone->joint2_pos.y - bone->joint1_pos.y;
-  float distance = sqrtf(dx * dx + dy * dy);
+  RB_Scalar dx = bone->joint2_pos.x - bone->joint1_pos.x;
+  RB_Scalar dy = bone->joint2_pos.y - bone->joint1_pos.y;
+  RB_Scalar distance = rb_sqrt(dx * dx + dy * dy);
 
-  float angle = atan2f(dy, dx);
+#ifdef RB_DETERMINISTIC
+  // cos/sin of atan2(dy, dx) without libm, whose trig results differ
+  // between platforms. sqrtf and division are exactly rounded everywhere.
+  RB_Scalar cos_angle = 1;
+  RB_Scalar sin_angle = 0;
+  if (distance > 0) {
+    cos_angle = dx / distance;
+    sin_angle = dy / distance;
+  }
+#else
+  RB_Scalar angle = rb_atan2(dy, dx);
+  RB_Scalar cos_angle = rb_cos(angle);
+  RB_Scalar sin_angle = rb_sin(angle);
+#endif
 
-  float rel_vel =
-      ((bone->joint2_velocity.x - bone->joint1_velocity.x) * cosf(angle) +
-       (bone->joint2_velocity.y - bone->joint1_velocity.y) * sinf(angle));
+  RB_Scalar rel_vel =
+      ((bone->joint2_velocity.x - bone->joint1_velocity.x) * cos_angle +
+       (bone->joint2_velocity.y - bone->joint1_velocity.y) * sin_angle);
 
-  float spring_force =
+  RB_Scalar spring_force =
       rb_global_config.spring_scale * (distance - bone->length);
-  float damping_force = rb_global_config.damping_scale * rel_vel;
+  RB_Scalar damping_force = rb_global_config.damping_scale * rel_vel;
 
-  float force = spring_force + damping_force;
+  RB_Scalar force = spring_force + damping_force;
 
-  bone->joint1_force.x = force * cosf(angle);
-  bone->joint1_force.y = force * sinf(angle);
-  bone->joint2_force.x = -force * cosf(angle);
-  bone->joint2_force.y = -force * sinf(angle);
+  bone->joint1_force.x = force * cos_angle;
+  bone->joint1_force.y = force * sin_angle;
+  bone->joint2_force.x = -force * cos_angle;
+  bone->joint2_force.y = -force * sin_angle;
 }
 
-void rb_calculate_joint_resistance(RB_Bone *bone, float dt)
+void rb_calculate_joint_resistance(RB_Bone *bone, RB_Scalar dt)
 {
   if (bone->joint1) {
     RB_Bone *parent = (RB_Bone *)bone->joint1;
@@ -58,7 +110,7 @@ void rb_calculate_joint_resistance(RB_Bone *bone, float dt)
   }
 }
 
-void rb_apply_gravity(RB_Bone *bone, float dt)
+void rb_apply_gravity(RB_Bone *bone, RB_Scalar dt)
 {
   if (bone->joint1_mass != 0) {
     bone->joint1_velocity.y += rb_global_config.gravity_scale * dt;
@@ -68,7 +120,7 @@ void rb_apply_gravity(RB_Bone *bone, float dt)
   }
 }
 
-void rb_apply_force(RB_Bone *bone, float dt)
+void rb_apply_force(RB_Bone *bone, RB_Scalar dt)
 {
   if (bone->joint1_mass != 0) {
     bone->joint1_velocity.x += bone->joint1_force.x / bone->joint1_mass * dt;
@@ -80,21 +132,33 @@ void rb_apply_force(RB_Bone *bone, float dt)
   }
 }
 
-void rb_apply_velocity(RB_Bone *bone, float dt)
+void rb_apply_velocity(RB_Bone *bone, RB_Scalar dt)
 {
+  if (bone->flags & RB_BONE_CCD) {
+    rb_sweep_joint(&bone->joint1_pos, &bone->joint1_velocity, dt);
+    rb_sweep_joint(&bone->joint2_pos, &bone->joint2_velocity, dt);
+    return;
+  }
+
   bone->joint1_pos.x += bone->joint1_velocity.x * dt;
   bone->joint1_pos.y += bone->joint1_velocity.y * dt;
   bone->joint2_pos.x += bone->joint2_velocity.x * dt;
   bone->joint2_pos.y += bone->joint2_velocity.y * dt;
 }
 
-void rb_apply_joint_constraint(RB_Bone *parent, RB_Bone *child, float dt)
+void rb_apply_joint_constraint(RB_Bone *parent, RB_Bone *child, RB_Scalar dt)
 {
     RB_Vector2 error = {child->joint1_pos.x - parent->joint2_pos.x,
                         child->joint1_pos.y - parent->joint2_pos.y};
 
-    float distance = sqrtf(error.x * error.x + error.y * error.y);
-    float correction_factor = (distance - child->length) * 0.5f;
+    RB_Scalar distance = rb_sqrt(error.x * error.x + error.y * error.y);
+    RB_Scalar correction_factor = (distance - child->length) * 0.5f;
+
+#ifdef RB_ENABLE_STATS
+    rb_step_stats.constraints_solved++;
+    rb_step_stats.max_constraint_error =
+        rb_max(rb_step_stats.max_constraint_error, distance);
+#endif
 
     if (distance > 0) {
         error.x /= distance;
@@ -111,8 +175,8 @@ void rb_apply_joint_constraint(RB_Bone *parent, RB_Bone *child, float dt)
     RB_Vector2 rel_vel = {child->joint1_velocity.x - parent->joint2_velocity.x,
                           child->joint1_velocity.y - parent->joint2_velocity.y};
 
-    float corrective_vel_x = rb_global_config.damping_scale * rel_vel.x;
-    float corrective_vel_y = rb_global_config.damping_scale * rel_vel.y;
+    RB_Scalar corrective_vel_x = rb_global_config.damping_scale * rel_vel.x;
+    RB_Scalar corrective_vel_y = rb_global_config.damping_scale * rel_vel.y;
 
     parent->joint2_velocity.x += corrective_vel_x * 0.5f * dt;
     parent->joint2_velocity.y += corrective_vel_y * 0.5f * dt;
@@ -127,7 +191,7 @@ void rb_pre_update_bones(RB_Bone *bones, size_t bones_count)
   }
 }
 
-void rb_update_bone(RB_Bone *bone, float dt)
+void rb_update_bone(RB_Bone *bone, RB_Scalar dt)
 {
   rb_calculate_object_resistance_force(bone);
   rb_calculate_joint_resistance(bone, dt);
@@ -136,13 +200,55 @@ void rb_update_bone(RB_Bone *bone, float dt)
   rb_apply_velocity(bone, dt);
 }
 
-void rb_update_bones(RB_Bone *bones, size_t bones_count, float dt)
+// indices selects the bones to step, all of them when null. The test is
+// loop invariant, so the compiler hoists it out of the loops.
+#define BONE(i) (&bones[indices ? indices[i] : (i)])
+
+// rb_pre_update_bones followed by rb_update_bone on every bone, with the
+// calls of rb_update_bone timed one by one.
+static inline void update_list(RB_Bone *bones, const uint32_t *indices,
+                               size_t count, RB_Scalar dt)
 {
-  rb_pre_update_bones(bones, bones_count);
+  PHASE_BEGIN();
 
-  for (size_t i = 0; i < bones_count; ++i) {
-    rb_update_bone(&bones[i], dt);
+  for (size_t i = 0; i < count; ++i) {
+    rb_calculate_object_resistance_force(BONE(i));
+  }
+  PHASE_END(RB_PHASE_FORCES);
+
+  for (size_t i = 0; i < count; ++i) {
+    RB_Bone *bone = BONE(i);
+
+    rb_calculate_object_resistance_force(bone);
+    PHASE_END(RB_PHASE_FORCES);
+    rb_calculate_joint_resistance(bone, dt);
+    PHASE_END(RB_PHASE_JOINTS);
+    rb_apply_gravity(bone, dt);
+    PHASE_END(RB_PHASE_GRAVITY);
+    rb_apply_force(bone, dt);
+    PHASE_END(RB_PHASE_INTEGRATE);
+    rb_apply_velocity(bone, dt);
+    PHASE_END(bone->flags & RB_BONE_CCD ? RB_PHASE_COLLISION
+                                        : RB_PHASE_INTEGRATE);
   }
+
+  PHASE_REPORT();
+}
+
+#undef BONE
+
+void rb_update_bones(RB_Bone *bones, size_t bones_count, RB_Scalar dt)
+{
+#ifdef RB_ENABLE_STATS
+  memset(&rb_step_stats, 0, sizeof(rb_step_stats));
+#endif
+  update_list(bones, 0, bones_count, dt);
+}
+
+void rb_update_bone_list(RB_Bone *bones, const uint32_t *indices,
+                         size_t count, RB_Scalar dt)
+{
+  update_list(bones, indices, count, dt);
 }
 
 void rb_connect_bone(RB_Bone *parent, RB_Bone *child)
@@ -152,3 +258,14 @@ void rb_connect_bone(RB_Bone *parent, RB_Bone *child)
   child->length = rb_calculate_distance(&child->joint1_pos, &child->joint2_pos);
   parent->joint2 = child;
 }
+
+void rb_apply_impulse(RB_Bone *bone, int joint, RB_Vector2 impulse)
+{
+  if (joint == 1 && bone->joint1_mass != 0) {
+    bone->joint1_velocity.x += impulse.x / bone->joint1_mass;
+    bone->joint1_velocity.y += impulse.y / bone->joint1_mass;
+  } else if (joint == 2 && bone->joint2_mass != 0) {
+    bone->joint2_velocity.x += impulse.x / bone->joint2_mass;
+    bone->joint2_velocity.y += impulse.y / bone->joint2_mass;
+  }
+}
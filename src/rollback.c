@@ -0,0 +1,212 @@
+#include "rigidbodylib.h"
+#include <string.h>
+
+int rb_rollback_init(RB_Rollback *rollback, size_t capacity, size_t max_bones,
+                     uint32_t interval)
+{
+  memset(rollback, 0, sizeof(*rollback));
+  if (!capacity || !interval) {
+    return -1;
+  }
+
+  rollback->states = malloc(capacity * max_bones * sizeof(RB_BoneState));
+  rollback->counts = malloc(capacity * sizeof(size_t));
+  rollback->dts = malloc(capacity * interval * sizeof(RB_Scalar));
+  rollback->capacity = capacity;
+  rollback->max_bones = max_bones;
+  rollback->interval = interval;
+
+  if (!rollback->counts || !rollback->dts ||
+      (!rollback->states && max_bones)) {
+    rb_rollback_free(rollback);
+    return -1;
+  }
+  return 0;
+}
+
+void rb_rollback_free(RB_Rollback *rollback)
+{
+  free(rollback->states);
+  free(rollback->counts);
+  free(rollback->dts);
+  memset(rollback, 0, sizeof(*rollback));
+}
+
+static size_t capture_slot(const RB_Rollback *rollback, uint64_t frame)
+{
+  return (size_t)(frame / rollback->interval % rollback->capacity);
+}
+
+static size_t dt_slot(const RB_Rollback *rollback, uint64_t frame)
+{
+  return (size_t)(frame % (rollback->capacity * rollback->interval));
+}
+
+// Plain field copies, they compile to a few vector moves per bone.
+void rb_bone_states_save(const RB_Bone *bones, size_t bones_count,
+                         RB_BoneState *states)
+{
+  for (size_t i = 0; i < bones_count; ++i) {
+    states[i].joint1_pos = bones[i].joint1_pos;
+    states[i].joint2_pos = bones[i].joint2_pos;
+    states[i].joint1_velocity = bones[i].joint1_velocity;
+    states[i].joint2_velocity = bones[i].joint2_velocity;
+  }
+}
+
+void rb_bone_states_restore(RB_Bone *bones, size_t bones_count,
+                            const RB_BoneState *states)
+{
+  for (size_t i = 0; i < bones_count; ++i) {
+    bones[i].joint1_pos = states[i].joint1_pos;
+    bones[i].joint2_pos = states[i].joint2_pos;
+    bones[i].joint1_velocity = states[i].joint1_velocity;
+    bones[i].joint2_velocity = states[i].joint2_velocity;
+  }
+}
+
+static void capture(RB_Rollback *rollback, const RB_World *world)
+{
+  size_t slot = capture_slot(rollback, world->frame);
+  rb_bone_states_save(world->bones, world->bones_count,
+                      rollback->states + slot * rollback->max_bones);
+  rollback->counts[slot] = world->bones_count;
+}
+
+// Unlinks bones from the ones at or after count, which a restore drops.
+static void unlink_dropped(RB_Bone *bones, size_t count, size_t old_count)
+{
+  RB_Bone *first = bones + count;
+  RB_Bone *end = bones + old_count;
+  for (size_t i = 0; i < count; ++i) {
+    RB_Bone *joint1 = bones[i].joint1;
+    RB_Bone *joint2 = bones[i].joint2;
+    if (joint1 >= first && joint1 < end) {
+      bones[i].joint1 = 0;
+    }
+    if (joint2 >= first && joint2 < end) {
+      bones[i].joint2 = 0;
+    }
+  }
+}
+
+static void restore(const RB_Rollback *rollback, RB_World *world,
+                    uint64_t frame)
+{
+  size_t slot = capture_slot(rollback, frame);
+  size_t bones_count = rollback->counts[slot];
+  rb_bone_states_restore(world->bones, bones_count,
+                         rollback->states + slot * rollback->max_bones);
+
+  // Bones spawned after the capture are gone again.
+  if (bones_count < world->bones_count) {
+    unlink_dropped(world->bones, bones_count, world->bones_count);
+    if (world->islands) {
+      rb_islands_build(world->islands, world->bones, bones_count);
+    }
+  }
+  world->bones_count = bones_count;
+  world->frame = frame;
+}
+
+void rb_rollback_record(RB_Rollback *rollback, const RB_World *world,
+                        RB_Scalar dt)
+{
+  uint64_t frame = world->frame;
+  uint64_t interval = rollback->interval;
+
+  // A gap in the frame numbers or too many bones starts over.
+  if (frame < rollback->first_frame || frame > rollback->end_frame ||
+      world->bones_count > rollback->max_bones) {
+    rollback->first_frame = rollback->end_frame = frame;
+  }
+
+  if (frame % interval == 0) {
+    if (world->bones_count > rollback->max_bones) {
+      rollback->first_frame = rollback->end_frame = frame + 1;
+      return;
+    }
+    capture(rollback, world);
+    if (rollback->first_frame == rollback->end_frame) {
+      rollback->first_frame = frame;
+    }
+  } else if (rollback->first_frame == rollback->end_frame) {
+    // Nothing to step forward from until the next capture.
+    rollback->first_frame = rollback->end_frame = frame + 1;
+    return;
+  }
+
+  rollback->dts[dt_slot(rollback, frame)] = dt;
+  rollback->end_frame = frame + 1;
+
+  // The capture just written replaced the one capacity captures ago.
+  if (frame / interval >= rollback->capacity) {
+    uint64_t oldest = (frame / interval + 1 - rollback->capacity) * interval;
+    if (rollback->first_frame < oldest) {
+      rollback->first_frame = oldest;
+    }
+  }
+}
+
+int rb_world_rewind(RB_World *world, uint64_t frames, RB_ResimulateFn fn,
+                    void *user)
+{
+  RB_Rollback *rollback = world->rollback;
+  if (frames == 0) {
+    return 0;
+  }
+  if (!rollback || frames > world->frame) {
+    return -1;
+  }
+
+  uint64_t frame = world->frame - frames;
+  if (rollback->first_frame == rollback->end_frame ||
+      frame < rollback->first_frame || frame > rollback->end_frame) {
+    return -1;
+  }
+
+  // Steps between the capture and frame were recorded already, step them
+  // without recording so the frames after stay valid.
+  restore(rollback, world, frame - frame % rollback->interval);
+  while (world->frame < frame) {
+    if (fn) {
+      fn(world, user);
+    }
+    RB_Scalar dt = rollback->dts[dt_slot(rollback, world->frame)];
+    if (world->islands) {
+      rb_update_islands(world->islands, world->bones, dt);
+    } else {
+      rb_update_bones(world->bones, world->bones_count, dt);
+    }
+    world->frame++;
+  }
+  return 0;
+}
+
+int rb_world_resimulate(RB_World *world, uint64_t frames, RB_ResimulateFn fn,
+                        void *user)
+{
+  uint64_t target = world->frame;
+  if (rb_world_rewind(world, frames, fn, user) != 0) {
+    return -1;
+  }
+
+  // Each step rewrites only its own dt, so the dts of the frames still
+  // ahead survive until they are used. Commands pushed meanwhile wait for
+  // the next live step, and the monitor is not called again for frames
+  // it already saw.
+  RB_Rollback *rollback = world->rollback;
+  RB_CommandQueue *commands = world->commands;
+  RB_DiagnosticsMonitor *diagnostics = world->diagnostics;
+  world->commands = 0;
+  world->diagnostics = 0;
+  while (world->frame < target) {
+    if (fn) {
+      fn(world, user);
+    }
+    rb_world_step(world, rollback->dts[dt_slot(rollback, world->frame)]);
+  }
+  world->commands = commands;
+  world->diagnostics = diagnostics;
+  return 0;
+}
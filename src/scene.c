@@ -0,0 +1,283 @@
+#include "rigidbodylib.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lines are parsed in place out of a fixed read buffer, so a scene is
+// streamed once without per line allocations. A line has to fit into the
+// buffer.
+#define READ_BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+  RB_Bone *bones;
+  size_t capacity;
+  size_t count;
+  RB_Config config; // applied once the whole scene loaded
+} Scene;
+
+// Keywords are short, an inlined compare is much cheaper than strcmp calls.
+static int token_is(const char *token, const char *keyword)
+{
+  while (*keyword && *token == *keyword) {
+    token++;
+    keyword++;
+  }
+  return *token == *keyword;
+}
+
+static int is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Returns the next token, NUL terminated in place, or 0 at the end of line.
+static char *next_token(char **cursor)
+{
+  char *p = *cursor;
+  while (is_space(*p)) {
+    p++;
+  }
+  if (*p == '\0' || *p == '#') {
+    *cursor = p;
+    return 0;
+  }
+
+  char *token = p;
+  while (*p != '\0' && !is_space(*p)) {
+    p++;
+  }
+  if (*p != '\0') {
+    *p++ = '\0';
+  }
+  *cursor = p;
+  return token;
+}
+
+// Plain decimals with up to 15 significant digits are exact as an integer
+// over a power of ten, and one double division rounds them the same way
+// strtod does (Clinger's fast path). Anything else goes through strtod.
+static int parse_decimal(const char *token, double *value)
+{
+  static const double powers[] = {1e0, 1e1, 1e2,  1e3,  1e4,  1e5,
+                                  1e6, 1e7, 1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15};
+  const char *p = token;
+  int negative = *p == '-';
+  if (*p == '-' || *p == '+') {
+    p++;
+  }
+
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int decimals = 0;
+  int fraction = 0;
+  for (; *p; ++p) {
+    if (*p >= '0' && *p <= '9') {
+      mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+      digits++;
+      decimals += fraction;
+    } else if (*p == '.' && !fraction) {
+      fraction = 1;
+    } else {
+      return 0;
+    }
+  }
+  if (digits == 0 || digits > 15) {
+    return 0;
+  }
+
+  *value = (double)mantissa / powers[decimals];
+  if (negative) {
+    *value = -*value;
+  }
+  return 1;
+}
+
+static int parse_scalar(char **cursor, RB_Scalar *value)
+{
+  char *token = next_token(cursor);
+  double parsed;
+  char *end;
+  if (!token) {
+    return 0;
+  }
+  if (!parse_decimal(token, &parsed)) {
+    parsed = strtod(token, &end);
+    if (end == token || *end != '\0') {
+      return 0;
+    }
+  }
+  *value = (RB_Scalar)parsed;
+  return isfinite(*value); // nan, inf, or too large for RB_Scalar
+}
+
+static int parse_vector(char **cursor, RB_Vector2 *value)
+{
+  return parse_scalar(cursor, &value->x) && parse_scalar(cursor, &value->y);
+}
+
+static int parse_config(Scene *scene, char *cursor)
+{
+  RB_Config config = scene->config;
+  char *key;
+
+  while ((key = next_token(&cursor))) {
+    RB_Scalar *field;
+    if (token_is(key, "gravity")) {
+      field = &config.gravity_scale;
+    } else if (token_is(key, "spring")) {
+      field = &config.spring_scale;
+    } else if (token_is(key, "damping")) {
+      field = &config.damping_scale;
+    } else {
+      return 0;
+    }
+    if (!parse_scalar(&cursor, field)) {
+      return 0;
+    }
+  }
+
+  scene->config = config;
+  return 1;
+}
+
+static int parse_bone(Scene *scene, char *cursor)
+{
+  if (scene->count == scene->capacity) {
+    return 0;
+  }
+
+  RB_Bone *bone = &scene->bones[scene->count];
+  memset(bone, 0, sizeof(*bone));
+  bone->joint1_mass = 1;
+  bone->joint2_mass = 1;
+
+  RB_Scalar length = -1;
+  long parent = -1;
+  char *key;
+  int ok = 1;
+
+  while (ok && (key = next_token(&cursor))) {
+    if (token_is(key, "joint1")) {
+      ok = parse_vector(&cursor, &bone->joint1_pos);
+    } else if (token_is(key, "joint2")) {
+      ok = parse_vector(&cursor, &bone->joint2_pos);
+    } else if (token_is(key, "mass")) {
+      ok = parse_scalar(&cursor, &bone->joint1_mass) &&
+           parse_scalar(&cursor, &bone->joint2_mass);
+    } else if (token_is(key, "velocity1")) {
+      ok = parse_vector(&cursor, &bone->joint1_velocity);
+    } else if (token_is(key, "velocity2")) {
+      ok = parse_vector(&cursor, &bone->joint2_velocity);
+    } else if (token_is(key, "length")) {
+      ok = parse_scalar(&cursor, &length) && length >= 0;
+    } else if (token_is(key, "ccd")) {
+      bone->flags |= RB_BONE_CCD;
+    } else if (token_is(key, "parent")) {
+      char *token = next_token(&cursor);
+      char *end;
+      ok = token != 0;
+      if (ok) {
+        long index = strtol(token, &end, 10);
+        parent = index < 0 ? (long)scene->count + index : index;
+        ok = *end == '\0' && parent >= 0 && (size_t)parent < scene->count;
+      }
+    } else {
+      ok = 0;
+    }
+  }
+  if (!ok) {
+    return 0;
+  }
+
+  if (parent >= 0) {
+    rb_connect_bone(&scene->bones[parent], bone);
+  } else {
+    bone->length = rb_calculate_distance(&bone->joint1_pos, &bone->joint2_pos);
+  }
+  if (length >= 0) {
+    bone->length = length;
+  }
+
+  scene->count++;
+  return 1;
+}
+
+static int parse_line(Scene *scene, char *line)
+{
+  char *cursor = line;
+  char *keyword = next_token(&cursor);
+
+  if (!keyword) {
+    return 1; // blank or comment
+  }
+  if (token_is(keyword, "bone")) {
+    return parse_bone(scene, cursor);
+  }
+  if (token_is(keyword, "config")) {
+    return parse_config(scene, cursor);
+  }
+  return 0;
+}
+
+int rb_scene_load(FILE *file, RB_Bone *bones, size_t capacity,
+                  size_t *bones_count)
+{
+  char *buffer = malloc(READ_BUFFER_SIZE + 1);
+  if (!buffer) {
+    return -1;
+  }
+
+  Scene scene = {bones, capacity, 0, rb_global_config};
+  size_t used = 0;
+  int line = 0;
+  int result = 0;
+
+  for (;;) {
+    size_t read = fread(buffer + used, 1, READ_BUFFER_SIZE - used, file);
+    int end_of_file = read < READ_BUFFER_SIZE - used;
+    used += read;
+    buffer[used] = '\0';
+
+    char *start = buffer;
+    char *newline;
+    while ((newline = memchr(start, '\n', used - (start - buffer)))) {
+      *newline = '\0';
+      line++;
+      if (!parse_line(&scene, start)) {
+        result = line;
+        break;
+      }
+      start = newline + 1;
+    }
+    if (result != 0) {
+      break;
+    }
+
+    // Carry the unfinished line over to the next read.
+    used -= start - buffer;
+    memmove(buffer, start, used);
+
+    if (end_of_file) {
+      if (ferror(file)) {
+        result = -1;
+      } else if (used > 0) {
+        buffer[used] = '\0';
+        line++;
+        result = parse_line(&scene, buffer) ? 0 : line;
+      }
+      break;
+    }
+    if (used == READ_BUFFER_SIZE) {
+      result = line + 1; // line longer than the buffer
+      break;
+    }
+  }
+
+  free(buffer);
+  if (result == 0) {
+    rb_global_config = scene.config;
+  }
+  *bones_count = scene.count;
+  return result;
+}
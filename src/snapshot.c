@@ -0,0 +1,107 @@
+#include "rigidbodylib.h"
+#include <string.h>
+
+#define RECORD_SIZE (sizeof(RB_SnapshotLinks) + RB_BONE_STATE_SIZE)
+
+size_t rb_snapshot_size(size_t bones_count)
+{
+  return sizeof(RB_SnapshotHeader) + bones_count * RECORD_SIZE;
+}
+
+static int32_t link_to_index(const void *link, const RB_Bone *bones,
+                             size_t bones_count)
+{
+  if (!link) {
+    return -1;
+  }
+
+  const RB_Bone *bone = (const RB_Bone *)link;
+  if (bone < bones || bone >= bones + bones_count) {
+    return -2;
+  }
+  return (int32_t)(bone - bones);
+}
+
+size_t rb_snapshot_save(const RB_Bone *bones, size_t bones_count,
+                        void *buffer, size_t buffer_size)
+{
+  size_t size = rb_snapshot_size(bones_count);
+  if (buffer_size < size || bones_count > INT32_MAX) {
+    return 0;
+  }
+
+  RB_SnapshotHeader header = {
+      .magic = RB_SNAPSHOT_MAGIC,
+      .version = RB_SNAPSHOT_VERSION,
+      .record_size = (uint32_t)RECORD_SIZE,
+      .bones_count = (uint32_t)bones_count,
+      .config = rb_global_config,
+  };
+  memcpy(buffer, &header, sizeof(header));
+
+  unsigned char *record = (unsigned char *)buffer + sizeof(header);
+  for (size_t i = 0; i < bones_count; ++i) {
+    RB_SnapshotLinks links = {
+        link_to_index(bones[i].joint1, bones, bones_count),
+        link_to_index(bones[i].joint2, bones, bones_count),
+    };
+    if (links.joint1 < -1 || links.joint2 < -1) {
+      return 0;
+    }
+
+    memcpy(record, &links, sizeof(links));
+    memcpy(record + sizeof(links),
+           (const unsigned char *)&bones[i] + RB_BONE_STATE_OFFSET,
+           RB_BONE_STATE_SIZE);
+    record += RECORD_SIZE;
+  }
+
+  return size;
+}
+
+int rb_snapshot_load(const void *buffer, size_t buffer_size, RB_Bone *bones,
+                     size_t capacity, size_t *bones_count)
+{
+  RB_SnapshotHeader header;
+  if (buffer_size < sizeof(header)) {
+    return -1;
+  }
+  memcpy(&header, buffer, sizeof(header));
+
+  if (header.magic != RB_SNAPSHOT_MAGIC ||
+      header.version != RB_SNAPSHOT_VERSION ||
+      header.record_size != RECORD_SIZE || header.bones_count > capacity ||
+      buffer_size < rb_snapshot_size(header.bones_count)) {
+    return -1;
+  }
+
+  // Check every link before touching bones, so a bad snapshot leaves
+  // them as they were.
+  size_t count = header.bones_count;
+  const unsigned char *first = (const unsigned char *)buffer + sizeof(header);
+  const unsigned char *record = first;
+  for (size_t i = 0; i < count; ++i) {
+    RB_SnapshotLinks links;
+    memcpy(&links, record, sizeof(links));
+    if (links.joint1 < -1 || links.joint1 >= (int32_t)count ||
+        links.joint2 < -1 || links.joint2 >= (int32_t)count) {
+      return -1;
+    }
+    record += RECORD_SIZE;
+  }
+
+  record = first;
+  for (size_t i = 0; i < count; ++i) {
+    RB_SnapshotLinks links;
+    memcpy(&links, record, sizeof(links));
+    bones[i].joint1 = links.joint1 >= 0 ? &bones[links.joint1] : 0;
+    bones[i].joint2 = links.joint2 >= 0 ? &bones[links.joint2] : 0;
+    memcpy((unsigned char *)&bones[i] + RB_BONE_STATE_OFFSET,
+           record + sizeof(links), RB_BONE_STATE_SIZE);
+    record += RECORD_SIZE;
+  }
+
+  rb_global_config = header.config;
+  *bones_count = count;
+  return 0;
+}
@@ -0,0 +1,292 @@
+#include "rigidbodylib.h"
+#include "rb_math.h"
+#include <string.h>
+
+#define BLOCK_SIZE 16
+#define HEADER_SIZE (3 * sizeof(uint32_t))
+#define COORDS_PER_BONE 4
+
+typedef struct {
+  uint8_t *data;
+  size_t size;
+  uint64_t bits;
+  int bit_count;
+} BitWriter;
+
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+  uint64_t bits;
+  int bit_count;
+} BitReader;
+
+static void write_bits(BitWriter *writer, uint32_t value, int count)
+{
+  if (count == 0) {
+    return;
+  }
+  writer->bits |= (uint64_t)value << writer->bit_count;
+  writer->bit_count += count;
+  while (writer->bit_count >= 8) {
+    writer->data[writer->size++] = (uint8_t)writer->bits;
+    writer->bits >>= 8;
+    writer->bit_count -= 8;
+  }
+}
+
+static void flush_bits(BitWriter *writer)
+{
+  if (writer->bit_count > 0) {
+    writer->data[writer->size++] = (uint8_t)writer->bits;
+  }
+  writer->bits = 0;
+  writer->bit_count = 0;
+}
+
+static int read_bits(BitReader *reader, int count, uint32_t *value)
+{
+  while (reader->bit_count < count) {
+    if (reader->size == 0) {
+      return 0;
+    }
+    reader->bits |= (uint64_t)*reader->data++ << reader->bit_count;
+    reader->size--;
+    reader->bit_count += 8;
+  }
+
+  *value = count ? (uint32_t)(reader->bits & ((1ull << count) - 1)) : 0;
+  reader->bits >>= count;
+  reader->bit_count -= count;
+  return 1;
+}
+
+static void align_reader(BitReader *reader)
+{
+  reader->bits = 0;
+  reader->bit_count = 0;
+}
+
+static uint32_t zigzag(uint32_t delta)
+{
+  return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static uint32_t unzigzag(uint32_t value)
+{
+  return (value >> 1) ^ (0u - (value & 1));
+}
+
+static int bit_width(uint32_t value)
+{
+  int width = 0;
+  while (value) {
+    width++;
+    value >>= 1;
+  }
+  return width;
+}
+
+static int32_t quantize(RB_Scalar v, RB_Scalar quantum)
+{
+  RB_Scalar q = rb_floor(v / quantum + 0.5f);
+  if (isnan(q)) {
+    return 0;
+  }
+  if (q >= (RB_Scalar)INT32_MAX) {
+    return INT32_MAX;
+  }
+  if (q <= (RB_Scalar)INT32_MIN) {
+    return INT32_MIN;
+  }
+  return (int32_t)q;
+}
+
+static int history_init(int32_t **frames, uint32_t *frame_ids,
+                        size_t bones_count)
+{
+  *frames = malloc(RB_STREAM_HISTORY * bones_count * COORDS_PER_BONE *
+                   sizeof(int32_t));
+  for (int i = 0; i < RB_STREAM_HISTORY; ++i) {
+    frame_ids[i] = RB_STREAM_KEYFRAME;
+  }
+  return *frames || !bones_count ? 0 : -1;
+}
+
+static int32_t *history_slot(int32_t *frames, size_t bones_count,
+                             uint32_t frame)
+{
+  return frames + (size_t)(frame % RB_STREAM_HISTORY) * bones_count *
+                      COORDS_PER_BONE;
+}
+
+int rb_stream_encoder_init(RB_StreamEncoder *encoder, size_t bones_count,
+                           RB_Scalar quantum)
+{
+  memset(encoder, 0, sizeof(*encoder));
+  encoder->quantum = quantum;
+  encoder->bones_count = bones_count;
+  encoder->acked_frame = RB_STREAM_KEYFRAME;
+  return history_init(&encoder->frames, encoder->frame_ids, bones_count);
+}
+
+void rb_stream_encoder_free(RB_StreamEncoder *encoder)
+{
+  free(encoder->frames);
+  encoder->frames = 0;
+}
+
+void rb_stream_encoder_ack(RB_StreamEncoder *encoder, uint32_t frame)
+{
+  encoder->acked_frame = frame;
+}
+
+size_t rb_stream_encode_bound(size_t bones_count)
+{
+  size_t values = bones_count * COORDS_PER_BONE;
+  size_t blocks = (values + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  return HEADER_SIZE + blocks * (1 + BLOCK_SIZE * 4);
+}
+
+size_t rb_stream_encode(RB_StreamEncoder *encoder, uint32_t frame,
+                        const RB_Bone *bones, void *out, size_t out_size)
+{
+  size_t bones_count = encoder->bones_count;
+  if (out_size < rb_stream_encode_bound(bones_count) ||
+      frame == RB_STREAM_KEYFRAME) {
+    return 0;
+  }
+
+  // Fall back to a keyframe when nothing was acked, the acked frame was
+  // evicted, or this frame is about to overwrite its slot.
+  uint32_t baseline = encoder->acked_frame;
+  if (baseline == RB_STREAM_KEYFRAME ||
+      encoder->frame_ids[baseline % RB_STREAM_HISTORY] != baseline ||
+      baseline % RB_STREAM_HISTORY == frame % RB_STREAM_HISTORY) {
+    baseline = RB_STREAM_KEYFRAME;
+  }
+
+  int32_t *current = history_slot(encoder->frames, bones_count, frame);
+  for (size_t i = 0; i < bones_count; ++i) {
+    current[i * 4 + 0] = quantize(bones[i].joint1_pos.x, encoder->quantum);
+    current[i * 4 + 1] = quantize(bones[i].joint1_pos.y, encoder->quantum);
+    current[i * 4 + 2] = quantize(bones[i].joint2_pos.x, encoder->quantum);
+    current[i * 4 + 3] = quantize(bones[i].joint2_pos.y, encoder->quantum);
+  }
+  encoder->frame_ids[frame % RB_STREAM_HISTORY] = frame;
+
+  const int32_t *base =
+      baseline == RB_STREAM_KEYFRAME
+          ? 0
+          : history_slot(encoder->frames, bones_count, baseline);
+
+  uint32_t header[3] = {frame, baseline, (uint32_t)bones_count};
+  memcpy(out, header, sizeof(header));
+
+  BitWriter writer = {(uint8_t *)out, HEADER_SIZE, 0, 0};
+  size_t values = bones_count * COORDS_PER_BONE;
+  uint32_t block[BLOCK_SIZE];
+
+  for (size_t first = 0; first < values; first += BLOCK_SIZE) {
+    size_t count = values - first < BLOCK_SIZE ? values - first : BLOCK_SIZE;
+    uint32_t bits = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t value = (uint32_t)current[first + i];
+      if (base) {
+        value -= (uint32_t)base[first + i];
+      }
+      block[i] = zigzag(value);
+      bits |= block[i];
+    }
+
+    // One width byte per block, then every value with that many bits.
+    // Resting bones produce all-zero blocks that cost a single byte.
+    int width = bit_width(bits);
+    writer.data[writer.size++] = (uint8_t)width;
+    for (size_t i = 0; i < count; ++i) {
+      write_bits(&writer, block[i], width);
+    }
+    flush_bits(&writer);
+  }
+
+  return writer.size;
+}
+
+int rb_stream_decoder_init(RB_StreamDecoder *decoder, size_t bones_count,
+                           RB_Scalar quantum)
+{
+  memset(decoder, 0, sizeof(*decoder));
+  decoder->quantum = quantum;
+  decoder->bones_count = bones_count;
+  return history_init(&decoder->frames, decoder->frame_ids, bones_count);
+}
+
+void rb_stream_decoder_free(RB_StreamDecoder *decoder)
+{
+  free(decoder->frames);
+  decoder->frames = 0;
+}
+
+int rb_stream_decode(RB_StreamDecoder *decoder, const void *data, size_t size,
+                     uint32_t *frame, RB_Vector2 *positions)
+{
+  size_t bones_count = decoder->bones_count;
+  uint32_t header[3];
+  if (size < HEADER_SIZE) {
+    return -1;
+  }
+  memcpy(header, data, sizeof(header));
+  if (header[0] == RB_STREAM_KEYFRAME || header[2] != bones_count) {
+    return -1;
+  }
+
+  uint32_t baseline = header[1];
+  const int32_t *base = 0;
+  if (baseline != RB_STREAM_KEYFRAME) {
+    if (decoder->frame_ids[baseline % RB_STREAM_HISTORY] != baseline) {
+      return -1;
+    }
+    base = history_slot(decoder->frames, bones_count, baseline);
+  }
+
+  // The encoder never picks a baseline sharing this frame's slot, so the
+  // slot can be written while reading the baseline.
+  // A packet that fails halfway leaves the slot half written, so it
+  // names no frame until this one decodes completely.
+  int32_t *current = history_slot(decoder->frames, bones_count, header[0]);
+  decoder->frame_ids[header[0] % RB_STREAM_HISTORY] = RB_STREAM_KEYFRAME;
+  BitReader reader = {(const uint8_t *)data + HEADER_SIZE, size - HEADER_SIZE,
+                      0, 0};
+  size_t values = bones_count * COORDS_PER_BONE;
+
+  for (size_t first = 0; first < values; first += BLOCK_SIZE) {
+    size_t count = values - first < BLOCK_SIZE ? values - first : BLOCK_SIZE;
+    uint32_t width;
+    if (!read_bits(&reader, 8, &width) || width > 32) {
+      return -1;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t value;
+      if (!read_bits(&reader, (int)width, &value)) {
+        return -1;
+      }
+      value = unzigzag(value);
+      if (base) {
+        value += (uint32_t)base[first + i];
+      }
+      current[first + i] = (int32_t)value;
+    }
+    align_reader(&reader);
+  }
+
+  decoder->frame_ids[header[0] % RB_STREAM_HISTORY] = header[0];
+  *frame = header[0];
+  for (size_t i = 0; i < bones_count; ++i) {
+    positions[i * 2].x = current[i * 4 + 0] * decoder->quantum;
+    positions[i * 2].y = current[i * 4 + 1] * decoder->quantum;
+    positions[i * 2 + 1].x = current[i * 4 + 2] * decoder->quantum;
+    positions[i * 2 + 1].y = current[i * 4 + 3] * decoder->quantum;
+  }
+  return 0;
+}
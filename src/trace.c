@@ -0,0 +1,176 @@
+#include "rigidbodylib.h"
+#include "rb_profile.h"
+
+#ifdef RB_ENABLE_TRACE
+#include <pthread.h>
+#include <stdatomic.h>
+
+typedef struct {
+  const char *name;
+  const char *arg_name;
+  int64_t arg;
+  double start;
+  double end;
+} TraceEvent;
+
+// One per recording thread, freed when the thread exits, so events of
+// finished threads are gone from later dumps. Only the owner writes
+// events; head is published with release so a dump sees complete events.
+// The list only changes when a thread records for the first time or
+// exits, so a mutex guards it and recording itself takes no lock.
+typedef struct TraceBuffer {
+  TraceEvent events[RB_TRACE_CAPACITY];
+  _Atomic uint64_t head;
+  int tid;
+  struct TraceBuffer *next;
+} TraceBuffer;
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static TraceBuffer *trace_buffers;
+static int trace_next_tid;
+static _Thread_local TraceBuffer *trace_buffer;
+
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+
+// Runs at thread exit through trace_key.
+static void unregister_buffer(void *data)
+{
+  TraceBuffer *buffer = data;
+
+  pthread_mutex_lock(&trace_lock);
+  TraceBuffer **link = &trace_buffers;
+  while (*link != buffer) {
+    link = &(*link)->next;
+  }
+  *link = buffer->next;
+  pthread_mutex_unlock(&trace_lock);
+
+  trace_buffer = 0;
+  free(buffer);
+}
+
+static void create_key(void)
+{
+  pthread_key_create(&trace_key, unregister_buffer);
+}
+
+static TraceBuffer *register_buffer(void)
+{
+  pthread_once(&trace_key_once, create_key);
+
+  TraceBuffer *buffer = malloc(sizeof(TraceBuffer));
+  if (!buffer) {
+    return 0;
+  }
+  if (pthread_setspecific(trace_key, buffer) != 0) {
+    free(buffer);
+    return 0;
+  }
+  atomic_init(&buffer->head, 0);
+
+  pthread_mutex_lock(&trace_lock);
+  buffer->tid = ++trace_next_tid;
+  buffer->next = trace_buffers;
+  trace_buffers = buffer;
+  pthread_mutex_unlock(&trace_lock);
+  return buffer;
+}
+
+void rb_trace_event(const char *name, const char *arg_name, int64_t arg,
+                    double start, double end)
+{
+  if (!trace_buffer && !(trace_buffer = register_buffer())) {
+    return;
+  }
+
+  uint64_t head =
+      atomic_load_explicit(&trace_buffer->head, memory_order_relaxed);
+  TraceEvent *event = &trace_buffer->events[head % RB_TRACE_CAPACITY];
+  event->name = name;
+  event->arg_name = arg_name;
+  event->arg = arg;
+  event->start = start;
+  event->end = end;
+  atomic_store_explicit(&trace_buffer->head, head + 1, memory_order_release);
+}
+
+double rb_trace_now(void)
+{
+  return rb_profile_now();
+}
+
+int rb_trace_dump(FILE *file)
+{
+  int first = 1;
+  fprintf(file, "{\"traceEvents\":[");
+
+  pthread_mutex_lock(&trace_lock);
+  for (TraceBuffer *buffer = trace_buffers; buffer; buffer = buffer->next) {
+    uint64_t head =
+        atomic_load_explicit(&buffer->head, memory_order_acquire);
+    uint64_t begin = head > RB_TRACE_CAPACITY ? head - RB_TRACE_CAPACITY : 0;
+
+    fprintf(file,
+            "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%d,\"args\":{\"name\":\"rigidbodylib %d\"}}",
+            first ? "" : ",", buffer->tid, buffer->tid);
+    first = 0;
+
+    for (uint64_t i = begin; i < head; ++i) {
+      const TraceEvent *event = &buffer->events[i % RB_TRACE_CAPACITY];
+      fprintf(file,
+              ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+              "\"ts\":%.3f,\"dur\":%.3f",
+              event->name, buffer->tid, event->start * 1e6,
+              (event->end - event->start) * 1e6);
+      if (event->arg_name) {
+        fprintf(file, ",\"args\":{\"%s\":%lld}", event->arg_name,
+                (long long)event->arg);
+      }
+      fputc('}', file);
+    }
+  }
+  pthread_mutex_unlock(&trace_lock);
+
+  fprintf(file, "\n]}\n");
+  return ferror(file) ? -1 : 0;
+}
+
+void rb_trace_reset(void)
+{
+  pthread_mutex_lock(&trace_lock);
+  for (TraceBuffer *buffer = trace_buffers; buffer; buffer = buffer->next) {
+    atomic_store(&buffer->head, 0);
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+#else
+
+void rb_trace_event(const char *name, const char *arg_name, int64_t arg,
+                    double start, double end)
+{
+  (void)name;
+  (void)arg_name;
+  (void)arg;
+  (void)start;
+  (void)end;
+}
+
+double rb_trace_now(void)
+{
+  return 0;
+}
+
+int rb_trace_dump(FILE *file)
+{
+  fprintf(file, "{\"traceEvents\":[]}\n");
+  return ferror(file) ? -1 : 0;
+}
+
+void rb_trace_reset(void)
+{
+}
+
+#endif
@@ -0,0 +1,63 @@
+#include "rigidbodylib.h"
+#include "rb_profile.h"
+#include <string.h>
+
+static void check_diagnostics(RB_World *world, RB_DiagnosticsMonitor *monitor)
+{
+  RB_Diagnostics *last = &monitor->last;
+  rb_compute_diagnostics(world->bones, world->bones_count, last);
+
+  int exceeded =
+      (monitor->max_length_error > 0 &&
+       last->max_length_error > monitor->max_length_error) ||
+      (monitor->max_joint_separation > 0 &&
+       last->max_joint_separation > monitor->max_joint_separation) ||
+      (monitor->max_kinetic_energy > 0 &&
+       last->kinetic_energy > monitor->max_kinetic_energy);
+  // NaN compares false with every threshold, catch exploded rigs too.
+  int invalid = last->kinetic_energy != last->kinetic_energy;
+
+  if ((exceeded || invalid) && monitor->fn) {
+    monitor->fn(world, last, monitor->user);
+  }
+}
+
+void rb_world_init(RB_World *world, RB_Bone *bones, size_t bones_count)
+{
+  world->bones = bones;
+  world->bones_count = bones_count;
+  world->bones_capacity = bones_count;
+  world->frame = 0;
+  world->rollback = 0;
+  world->diagnostics = 0;
+  world->islands = 0;
+  world->commands = 0;
+  memset(&world->stats, 0, sizeof(world->stats));
+}
+
+void rb_world_step(RB_World *world, RB_Scalar dt)
+{
+#ifdef RB_ENABLE_TRACE
+  double start = rb_profile_now();
+#endif
+
+  if (world->commands) {
+    rb_command_queue_drain(world->commands, world);
+  }
+  if (world->rollback) {
+    rb_rollback_record(world->rollback, world, dt);
+  }
+
+  if (world->islands) {
+    rb_update_islands(world->islands, world->bones, dt);
+  } else {
+    rb_update_bones(world->bones, world->bones_count, dt);
+  }
+  world->stats = rb_step_stats;
+  RB_TRACE("step", "frame", (int64_t)world->frame, start, rb_profile_now());
+  world->frame++;
+
+  if (world->diagnostics) {
+    check_diagnostics(world, world->diagnostics);
+  }
+}